@@ -0,0 +1,425 @@
+#include "broadcast.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QDateTime>
+
+// Station names come from file names and tags, so control characters
+// are replaced, rather than letting them end a header or playlist line.
+static QByteArray GetSafeName(Station* station)
+{
+    QByteArray name = station->GetName().toUtf8();
+    for (int itx = 0; itx < name.size(); itx ++)
+        if ((unsigned char)name[itx] < 0x20 || name[itx] == 0x7f)
+            name[itx] = ' ';
+    return name;
+}
+
+BroadcastStation::BroadcastStation(Station* station) : ring(BROADCAST_RING_DURATION)
+{
+    this->station = station;
+    this->recorder = nullptr;
+    this->send_buffer.resize(BROADCAST_MAX_PENDING);
+}
+
+void BroadcastStation::AddListener(QTcpSocket* socket)
+{
+    // Recording starts from the live position of the station on the next update
+    qint64& cursor = this->listeners[socket];
+    cursor = this->ring.FindFrameOffset(this->ring.GetLiveTime() - BROADCAST_PREBUFFER_DURATION);
+    this->SendTo(socket, cursor);
+}
+
+bool BroadcastStation::RemoveListener(QTcpSocket* socket)
+{
+    if (this->listeners.remove(socket) == 0)
+        return false;
+
+    // Stop recording once nobody is listening
+    if (this->listeners.isEmpty())
+    {
+        delete this->recorder;
+        this->recorder = nullptr;
+        this->ring.Clear();
+    }
+    return true;
+}
+
+int BroadcastStation::GetListenerCount()
+{
+    return this->listeners.count();
+}
+
+void BroadcastStation::Update(qint64 timeline_position)
+{
+    if (this->listeners.isEmpty())
+        return;
+
+    // Frames are read once per station, however many are listening
+    if (this->recorder == nullptr)
+        this->recorder = new TimeShiftRecorder(this->station->GetFilePath(), this->station->GetSchedule(), &this->ring);
+    this->recorder->Update(timeline_position);
+    for (QHash<QTcpSocket*, qint64>::iterator it = this->listeners.begin(); it != this->listeners.end(); ++ it)
+        this->SendTo(it.key(), it.value());
+}
+
+void BroadcastStation::Send(QTcpSocket* socket)
+{
+    QHash<QTcpSocket*, qint64>::iterator it = this->listeners.find(socket);
+    if (it != this->listeners.end())
+        this->SendTo(socket, it.value());
+}
+
+void BroadcastStation::SendTo(QTcpSocket* socket, qint64& cursor)
+{
+    static MetricsCounter* sent_metric = Metrics::Instance()->GetCounter(
+        "gta_broadcast_sent_bytes_total", "Audio sent to broadcast listeners");
+    static MetricsCounter* skipped_metric = Metrics::Instance()->GetCounter(
+        "gta_broadcast_skipped_bytes_total", "Audio skipped by broadcast listeners that fell behind");
+
+    // Oldest frames may have been dropped whilst the listener was behind
+    qint64 start_offset = this->ring.GetStartOffset();
+    if (cursor < start_offset)
+    {
+        skipped_metric->Increment(start_offset - cursor);
+        cursor = start_offset;
+    }
+
+    // Only top up to the limit, the rest is sent as the socket drains
+    qint64 space = BROADCAST_MAX_PENDING - socket->bytesToWrite();
+    if (space <= 0)
+        return;
+    qint64 read_size = this->ring.Read(cursor, this->send_buffer.data(), space);
+    if (read_size <= 0)
+        return;
+    socket->write(this->send_buffer.constData(), read_size);
+    cursor += read_size;
+    sent_metric->Increment(read_size);
+}
+
+BroadcastStation::~BroadcastStation()
+{
+    delete this->recorder;
+}
+
+BroadcastServer::BroadcastServer(QObject* parent) : QObject(parent)
+{
+    this->startup_time = QDateTime::currentMSecsSinceEpoch();
+    this->server = new QTcpServer(this);
+    QObject::connect(this->server, SIGNAL(newConnection()), this, SLOT(OnNewConnection()));
+
+    // Stations are paced by the global timeline, on a single timer
+    this->tick_timer = new QTimer(this);
+    QObject::connect(this->tick_timer, SIGNAL(timeout()), this, SLOT(OnTick()));
+
+    Metrics* metrics = Metrics::Instance();
+    this->listeners_metric = metrics->GetGauge("gta_broadcast_listeners", "Listeners connected to the broadcast server");
+    this->connections_metric = metrics->GetCounter("gta_broadcast_connections_total", "Connections made to the broadcast server");
+}
+
+bool BroadcastServer::Listen(QHostAddress address, quint16 port)
+{
+    if (! this->server->listen(address, port))
+    {
+        std::cout << "Unable to start broadcast server on " << address.toString().toStdString() << ":" << port
+                  << ": " << this->server->errorString().toStdString() << std::endl;
+        return false;
+    }
+    std::cout << "Broadcasting stations on " << address.toString().toStdString() << ":" << port << std::endl;
+    this->tick_timer->start(BROADCAST_TICK_INTERVAL);
+    return true;
+}
+
+void BroadcastServer::SetStations(QList<Station*> stations)
+{
+    // Listeners of old stations are disconnected, as the
+    // stations are about to be deleted.
+    this->RemoveBroadcasts();
+    this->stations = stations;
+    this->broadcasts.fill(nullptr, stations.count());
+}
+
+void BroadcastServer::RemoveBroadcasts()
+{
+    QList<QTcpSocket*> sockets = this->findChildren<QTcpSocket*>();
+    for (int itx = 0; itx < sockets.count(); itx ++)
+    {
+        sockets[itx]->disconnect(this);
+        sockets[itx]->abort();
+        sockets[itx]->deleteLater();
+    }
+    qDeleteAll(this->broadcasts);
+    this->broadcasts.clear();
+    this->UpdateListenersMetric();
+}
+
+void BroadcastServer::SetStartupTime(qint64 startup_time)
+{
+    this->startup_time = startup_time;
+}
+
+qint64 BroadcastServer::GetTimelinePosition()
+{
+    return QDateTime::currentMSecsSinceEpoch() - this->startup_time;
+}
+
+void BroadcastServer::OnTick()
+{
+    qint64 timeline_position = this->GetTimelinePosition();
+    for (int itx = 0; itx < this->broadcasts.count(); itx ++)
+        if (this->broadcasts[itx] != nullptr)
+            this->broadcasts[itx]->Update(timeline_position);
+}
+
+void BroadcastServer::OnNewConnection()
+{
+    while (this->server->hasPendingConnections())
+    {
+        QTcpSocket* socket = this->server->nextPendingConnection();
+        socket->setParent(this);
+        this->connections_metric->Increment();
+        QObject::connect(socket, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+        QObject::connect(socket, SIGNAL(disconnected()), this, SLOT(OnDisconnected()));
+
+        // Deleted with the socket, or once the request has been read
+        QTimer* request_timer = new QTimer(socket);
+        request_timer->setSingleShot(true);
+        QObject::connect(request_timer, SIGNAL(timeout()), this, SLOT(OnRequestTimeout()));
+        request_timer->start(BROADCAST_REQUEST_TIMEOUT);
+    }
+}
+
+void BroadcastServer::OnRequestTimeout()
+{
+    QTimer* request_timer = qobject_cast<QTimer*>(this->sender());
+    if (request_timer == nullptr)
+        return;
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(request_timer->parent());
+    if (socket != nullptr)
+        socket->abort();
+}
+
+void BroadcastServer::OnReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(this->sender());
+    if (socket == nullptr)
+        return;
+
+    // Wait for end of request headers
+    QByteArray request = socket->peek(BROADCAST_MAX_REQUEST_SIZE);
+    if (! request.contains("\r\n\r\n"))
+    {
+        if (request.size() >= BROADCAST_MAX_REQUEST_SIZE)
+            socket->abort();
+        return;
+    }
+    socket->readAll();
+    QObject::disconnect(socket, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+    delete socket->findChild<QTimer*>();
+
+    // Request line is 'GET <path> HTTP/1.x'
+    QList<QByteArray> lines = request.left(request.indexOf("\r\n\r\n")).split('\n');
+    QList<QByteArray> request_line = lines[0].trimmed().split(' ');
+    if (request_line.count() < 2 || (request_line[0] != "GET" && request_line[0] != "HEAD"))
+    {
+        this->SendError(socket, "405 Method Not Allowed");
+        return;
+    }
+
+    QByteArray path = request_line[1];
+    if (path == "/")
+    {
+        QByteArray host;
+        for (int itx = 1; itx < lines.count(); itx ++)
+            if (lines[itx].toLower().startsWith("host:"))
+                host = lines[itx].mid(5).trimmed();
+        this->SendPlaylist(socket, host);
+        return;
+    }
+
+    bool valid = false;
+    int station_index = path.mid(1).toInt(&valid);
+    if (! valid || station_index < 0 || station_index >= this->stations.count())
+    {
+        this->SendError(socket, "404 Not Found");
+        return;
+    }
+
+    // Streams are not on the global timeline, so are not rebroadcast.
+    // Packed stations have no station file to record from.
+    Station* station = this->stations[station_index];
+    if (station->IsStream() || station->IsPacked())
+    {
+        this->SendError(socket, "404 Not Found");
+        return;
+    }
+
+    socket->write("HTTP/1.0 200 OK\r\n"
+                  "Content-Type: audio/mpeg\r\n"
+                  "Cache-Control: no-cache\r\n"
+                  "icy-name: " + GetSafeName(station) + "\r\n"
+                  "Connection: close\r\n\r\n");
+    if (request_line[0] == "HEAD")
+    {
+        socket->disconnectFromHost();
+        return;
+    }
+
+    if (this->broadcasts[station_index] == nullptr)
+        this->broadcasts[station_index] = new BroadcastStation(station);
+    socket->setProperty(BROADCAST_PROPERTY_STATION, station_index);
+    QObject::connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(OnBytesWritten()));
+    this->broadcasts[station_index]->AddListener(socket);
+    this->UpdateListenersMetric();
+}
+
+void BroadcastServer::SendPlaylist(QTcpSocket* socket, QByteArray host)
+{
+    if (host.isEmpty())
+        host = socket->localAddress().toString().toUtf8() + ":" + QByteArray::number(socket->localPort());
+
+    QByteArray body = "#EXTM3U\r\n";
+    for (int itx = 0; itx < this->stations.count(); itx ++)
+    {
+        if (this->stations[itx]->IsStream() || this->stations[itx]->IsPacked())
+            continue;
+        body += "#EXTINF:-1," + GetSafeName(this->stations[itx]) + "\r\n";
+        body += "http://" + host + "/" + QByteArray::number(itx) + "\r\n";
+    }
+
+    socket->write("HTTP/1.0 200 OK\r\n"
+                  "Content-Type: audio/x-mpegurl\r\n"
+                  "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                  "Connection: close\r\n\r\n" + body);
+    socket->disconnectFromHost();
+}
+
+void BroadcastServer::SendError(QTcpSocket* socket, QByteArray status)
+{
+    socket->write("HTTP/1.0 " + status + "\r\n"
+                  "Content-Length: 0\r\n"
+                  "Connection: close\r\n\r\n");
+    socket->disconnectFromHost();
+}
+
+BroadcastStation* BroadcastServer::GetBroadcast(QTcpSocket* socket)
+{
+    // Set once the listener's request has been read
+    bool valid = false;
+    int station_index = socket->property(BROADCAST_PROPERTY_STATION).toInt(&valid);
+    if (! valid || station_index >= this->broadcasts.count())
+        return nullptr;
+    return this->broadcasts[station_index];
+}
+
+void BroadcastServer::OnBytesWritten()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(this->sender());
+    if (socket == nullptr)
+        return;
+
+    // Top up the listener as soon as there is space, rather than
+    // waiting for the next tick.
+    BroadcastStation* broadcast = this->GetBroadcast(socket);
+    if (broadcast != nullptr)
+        broadcast->Send(socket);
+}
+
+void BroadcastServer::OnDisconnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(this->sender());
+    if (socket == nullptr)
+        return;
+
+    BroadcastStation* broadcast = this->GetBroadcast(socket);
+    if (broadcast != nullptr)
+        broadcast->RemoveListener(socket);
+    socket->deleteLater();
+    this->UpdateListenersMetric();
+}
+
+void BroadcastServer::UpdateListenersMetric()
+{
+    int listener_count = 0;
+    for (int itx = 0; itx < this->broadcasts.count(); itx ++)
+        if (this->broadcasts[itx] != nullptr)
+            listener_count += this->broadcasts[itx]->GetListenerCount();
+    this->listeners_metric->Set(listener_count);
+}
+
+BroadcastServer::~BroadcastServer()
+{
+    this->RemoveBroadcasts();
+}
+
+BroadcastLoadTest::BroadcastLoadTest(QUrl url, int client_count, int duration)
+{
+    this->url = url;
+    this->client_count = client_count;
+    this->duration = duration;
+    this->disconnected = 0;
+    this->report_timer = new QTimer(this);
+    QObject::connect(this->report_timer, SIGNAL(timeout()), this, SLOT(Report()));
+}
+
+void BroadcastLoadTest::Start()
+{
+    std::cout << "Load test: connecting " << this->client_count << " clients to " << this->url.toString().toStdString() << std::endl;
+    this->received.fill(0, this->client_count);
+    for (int itx = 0; itx < this->client_count; itx ++)
+    {
+        QTcpSocket* socket = new QTcpSocket(this);
+        QObject::connect(socket, SIGNAL(connected()), this, SLOT(OnConnected()));
+        QObject::connect(socket, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+        QObject::connect(socket, SIGNAL(disconnected()), this, SLOT(OnDisconnected()));
+        this->sockets.append(socket);
+        socket->connectToHost(this->url.host(), this->url.port(80));
+    }
+    this->elapsed_timer.start();
+    this->report_timer->start(BROADCAST_LOAD_TEST_REPORT_INTERVAL);
+    QTimer::singleShot(this->duration, this, SLOT(Finish()));
+}
+
+void BroadcastLoadTest::OnConnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(this->sender());
+    QByteArray path = this->url.path().isEmpty() ? "/" : this->url.path().toUtf8();
+    socket->write("GET " + path + " HTTP/1.0\r\n"
+                  "Host: " + this->url.host().toUtf8() + "\r\n\r\n");
+}
+
+void BroadcastLoadTest::OnReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(this->sender());
+    int client = this->sockets.indexOf(socket);
+    // Headers are counted too, which is insignificant over the test
+    this->received[client] += socket->readAll().size();
+}
+
+void BroadcastLoadTest::OnDisconnected()
+{
+    this->disconnected ++;
+}
+
+void BroadcastLoadTest::Report()
+{
+    // Rate (kbit/s) each client is receiving at
+    QVector<qint64> rates;
+    qint64 elapsed = std::max(this->elapsed_timer.elapsed(), (qint64)1);
+    for (int itx = 0; itx < this->received.count(); itx ++)
+        rates.append(this->received[itx] * 8 / elapsed);
+    std::sort(rates.begin(), rates.end());
+
+    std::cout << "Load test: elapsed_ms=" << elapsed << " disconnected=" << this->disconnected
+              << " kbps_min=" << rates.first() << " kbps_median=" << rates[rates.count() / 2]
+              << " kbps_max=" << rates.last() << std::endl;
+}
+
+void BroadcastLoadTest::Finish()
+{
+    this->Report();
+    QCoreApplication::exit(this->disconnected == 0 ? 0 : 1);
+}
@@ -0,0 +1,145 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QUrl>
+
+#include "station.h"
+#include "schedule.h"
+#include "timeshift.h"
+#include "metrics.h"
+
+// Amount of audio (ms) held for each station being broadcast
+#define BROADCAST_RING_DURATION 10000
+// Amount of audio (ms) sent to a new listener ahead of the live position,
+// if it has already been recorded, so that it can start playing immediately.
+#define BROADCAST_PREBUFFER_DURATION 2000
+// Interval (ms) at which stations are recorded and sent to listeners
+#define BROADCAST_TICK_INTERVAL 100
+// Maximum data queued for a listener. Slower listeners skip audio
+// rather than holding memory for each of them.
+#define BROADCAST_MAX_PENDING 65536
+// Maximum size of an HTTP request accepted
+#define BROADCAST_MAX_REQUEST_SIZE 8192
+// Time (ms) allowed for a connection to send its request headers,
+// after which it is dropped, so idle connections are not held open.
+#define BROADCAST_REQUEST_TIMEOUT 10000
+// Property of a listener's socket, holding the index of its station
+#define BROADCAST_PROPERTY_STATION "broadcast_station"
+// Load test defaults, and interval (ms) at which it reports
+#define BROADCAST_LOAD_TEST_DEFAULT_CLIENTS 100
+#define BROADCAST_LOAD_TEST_DEFAULT_DURATION 60000
+#define BROADCAST_LOAD_TEST_REPORT_INTERVAL 5000
+
+// Station being broadcast, recorded at its position on the global
+// timeline into a ring of frames, which is shared by its listeners.
+// Each listener only holds a cursor (offset of the next byte to send)
+// into the ring.
+class BroadcastStation
+{
+
+public:
+    BroadcastStation(Station* station);
+    ~BroadcastStation();
+
+    void AddListener(QTcpSocket* socket);
+    bool RemoveListener(QTcpSocket* socket);
+    int GetListenerCount();
+    void Update(qint64 timeline_position);
+    void Send(QTcpSocket* socket);
+
+private:
+    Station* station;
+    TimeShiftBuffer ring;
+    // Only recorded whilst there are listeners
+    TimeShiftRecorder* recorder;
+    QHash<QTcpSocket*, qint64> listeners;
+    QByteArray send_buffer;
+
+    void SendTo(QTcpSocket* socket, qint64& cursor);
+};
+
+// HTTP server, streaming each station as MP3 to other devices,
+// e.g. 'http://<host>:<port>/3' for the fourth station.
+// '/' returns an M3U playlist of all stations.
+// Stations are paced by the global timeline as it runs without pausing,
+// so pausing the player does not stop other devices listening.
+class BroadcastServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    BroadcastServer(QObject* parent = nullptr);
+    ~BroadcastServer();
+
+    bool Listen(QHostAddress address, quint16 port);
+    void SetStations(QList<Station*> stations);
+    // Start of the global timeline, set when it is reset but not when paused
+    void SetStartupTime(qint64 startup_time);
+
+private slots:
+    void OnNewConnection();
+    void OnReadyRead();
+    void OnRequestTimeout();
+    void OnBytesWritten();
+    void OnDisconnected();
+    void OnTick();
+
+private:
+    qint64 startup_time;
+    QTcpServer* server;
+    QTimer* tick_timer;
+    QList<Station*> stations;
+    QVector<BroadcastStation*> broadcasts;
+
+    MetricsGauge* listeners_metric;
+    MetricsCounter* connections_metric;
+
+    qint64 GetTimelinePosition();
+    BroadcastStation* GetBroadcast(QTcpSocket* socket);
+    void RemoveBroadcasts();
+    void SendPlaylist(QTcpSocket* socket, QByteArray host);
+    void SendError(QTcpSocket* socket, QByteArray status);
+    void UpdateListenersMetric();
+};
+
+// Load test for the broadcast server. Opens many connections to
+// a station and reports how fast each is receiving audio, so that
+// several processes can be run against a server at once.
+class BroadcastLoadTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    BroadcastLoadTest(QUrl url, int client_count, int duration);
+
+    void Start();
+
+private slots:
+    void OnConnected();
+    void OnReadyRead();
+    void OnDisconnected();
+    void Report();
+    void Finish();
+
+private:
+    QUrl url;
+    int client_count;
+    int duration;
+    QList<QTcpSocket*> sockets;
+    QVector<qint64> received;
+    int disconnected;
+    QElapsedTimer elapsed_timer;
+    QTimer* report_timer;
+};
+
+#endif // BROADCAST_H
@@ -0,0 +1,374 @@
+#include "dsp.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QElapsedTimer>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Sample rate of audio generated for the benchmark
+#define DSP_BENCHMARK_SAMPLE_RATE 44100
+// State below this is flushed to zero, so that filters decaying
+// into silence do not slow down on denormal numbers.
+#define DSP_DENORMAL_THRESHOLD 1e-15
+// M_PI is not part of standard C++, so is not defined by every compiler
+#define DSP_PI 3.14159265358979323846
+
+DspSettings::DspSettings()
+{
+    this->preamp = 0;
+    this->bass_boost = 0;
+    this->radio = false;
+    this->soft_clip = false;
+}
+
+bool DspSettings::IsEnabled() const
+{
+    return ! this->bands.isEmpty() || this->preamp != 0 || this->bass_boost != 0 || this->radio || this->soft_clip;
+}
+
+DspSettings DspSettings::LoadForStation(QString station_file)
+{
+    DspSettings settings;
+    QFileInfo station(station_file);
+    QString file_path = station.absolutePath() + "/" + station.completeBaseName() + DSP_SETTINGS_SUFFIX;
+    if (! QFile::exists(file_path))
+        return settings;
+
+    QSettings source(file_path, QSettings::IniFormat);
+    source.beginGroup(DSP_SETTINGS_GROUP);
+    settings.preamp = source.value(DSP_SETTINGS_KEY_PREAMP, 0).toDouble();
+    settings.bass_boost = source.value(DSP_SETTINGS_KEY_BASS_BOOST, 0).toDouble();
+    settings.radio = source.value(DSP_SETTINGS_KEY_RADIO, false).toBool();
+    settings.soft_clip = source.value(DSP_SETTINGS_KEY_SOFT_CLIP, false).toBool();
+    source.endGroup();
+
+    int band_count = source.beginReadArray(DSP_SETTINGS_KEY_BANDS);
+    for (int itx = 0; itx < band_count; itx ++)
+    {
+        source.setArrayIndex(itx);
+        DspBand band;
+        band.frequency = source.value(DSP_SETTINGS_KEY_BAND_FREQUENCY, 0).toDouble();
+        band.gain = source.value(DSP_SETTINGS_KEY_BAND_GAIN, 0).toDouble();
+        band.q = source.value(DSP_SETTINGS_KEY_BAND_Q, DSP_DEFAULT_Q).toDouble();
+        settings.bands.append(band);
+    }
+    source.endArray();
+
+    std::cout << "Loaded DSP settings: " << file_path.toStdString() << std::endl;
+    return settings;
+}
+
+DspChain::DspChain()
+{
+    this->gain = 1;
+    this->soft_clip = false;
+    this->enabled = false;
+}
+
+void DspChain::Configure(const DspSettings& settings, int sample_rate)
+{
+    this->biquads.clear();
+    this->enabled = settings.IsEnabled();
+    this->gain = pow(10, settings.preamp / 20);
+    this->soft_clip = settings.soft_clip;
+
+    // Ignore bands that cannot be represented at this sample rate
+    double nyquist = sample_rate / 2.0;
+    for (int itx = 0; itx < settings.bands.count(); itx ++)
+    {
+        const DspBand& band = settings.bands[itx];
+        if (band.gain == 0 || band.frequency <= 0 || band.frequency >= nyquist || band.q <= 0)
+            continue;
+        this->biquads.append(DspChain::MakePeaking(band.frequency, band.gain, band.q, sample_rate));
+    }
+
+    if (settings.bass_boost != 0)
+        this->biquads.append(DspChain::MakeLowShelf(DSP_BASS_BOOST_FREQUENCY, settings.bass_boost, sample_rate));
+
+    if (settings.radio)
+    {
+        this->biquads.append(DspChain::MakeHighPass(DSP_RADIO_LOW_CUT, DSP_DEFAULT_Q, sample_rate));
+        this->biquads.append(DspChain::MakeLowPass(std::min((double)DSP_RADIO_HIGH_CUT, nyquist * 0.9), DSP_DEFAULT_Q, sample_rate));
+    }
+}
+
+bool DspChain::IsEnabled()
+{
+    return this->enabled;
+}
+
+void DspChain::Reset()
+{
+    for (int itx = 0; itx < this->biquads.count(); itx ++)
+    {
+        for (int channel = 0; channel < DSP_CHANNELS; channel ++)
+        {
+            this->biquads[itx].z1[channel] = 0;
+            this->biquads[itx].z2[channel] = 0;
+        }
+    }
+}
+
+void DspChain::Process(qint16* samples, qint64 frame_count)
+{
+    if (! this->enabled)
+        return;
+
+    // Each filter is run over a whole block at a time, which
+    // keeps the block and the filter state in cache/registers.
+    for (qint64 itx = 0; itx < frame_count; itx += DSP_BLOCK_FRAMES)
+        this->ProcessBlock(samples + itx * DSP_CHANNELS, (int)std::min(frame_count - itx, (qint64)DSP_BLOCK_FRAMES));
+}
+
+void DspChain::ProcessBlock(qint16* samples, int frame_count)
+{
+    this->LoadBlock(samples, frame_count * DSP_CHANNELS);
+    for (int itx = 0; itx < this->biquads.count(); itx ++)
+        this->FilterBlock(this->biquads[itx], frame_count);
+    this->StoreBlock(samples, frame_count * DSP_CHANNELS);
+}
+
+void DspChain::LoadBlock(const qint16* samples, int sample_count)
+{
+    const double scale = 1.0 / 32768.0;
+    int itx = 0;
+
+#ifdef __SSE2__
+    // Widen 8 samples at a time to 32-bit (duplicating each sample
+    // into the high half and shifting down extends the sign),
+    // then to double.
+    __m128d scale_pd = _mm_set1_pd(scale);
+    for (; itx + 8 <= sample_count; itx += 8)
+    {
+        __m128i pcm = _mm_loadu_si128((const __m128i*)(samples + itx));
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(pcm, pcm), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(pcm, pcm), 16);
+        _mm_storeu_pd(this->block + itx, _mm_mul_pd(_mm_cvtepi32_pd(low), scale_pd));
+        _mm_storeu_pd(this->block + itx + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(low, low)), scale_pd));
+        _mm_storeu_pd(this->block + itx + 4, _mm_mul_pd(_mm_cvtepi32_pd(high), scale_pd));
+        _mm_storeu_pd(this->block + itx + 6, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(high, high)), scale_pd));
+    }
+#endif
+
+    for (; itx < sample_count; itx ++)
+        this->block[itx] = samples[itx] * scale;
+}
+
+void DspChain::FilterBlock(Biquad& biquad, int frame_count)
+{
+    // Transposed direct form II
+#ifdef __SSE2__
+    // Left and right of a frame are filtered together
+    __m128d b0 = _mm_set1_pd(biquad.b0);
+    __m128d b1 = _mm_set1_pd(biquad.b1);
+    __m128d b2 = _mm_set1_pd(biquad.b2);
+    __m128d a1 = _mm_set1_pd(biquad.a1);
+    __m128d a2 = _mm_set1_pd(biquad.a2);
+    __m128d z1 = _mm_loadu_pd(biquad.z1);
+    __m128d z2 = _mm_loadu_pd(biquad.z2);
+    for (int itx = 0; itx < frame_count; itx ++)
+    {
+        double* frame = this->block + itx * DSP_CHANNELS;
+        __m128d x = _mm_loadu_pd(frame);
+        __m128d y = _mm_add_pd(_mm_mul_pd(b0, x), z1);
+        z1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, x), _mm_mul_pd(a1, y)), z2);
+        z2 = _mm_sub_pd(_mm_mul_pd(b2, x), _mm_mul_pd(a2, y));
+        _mm_storeu_pd(frame, y);
+    }
+    _mm_storeu_pd(biquad.z1, z1);
+    _mm_storeu_pd(biquad.z2, z2);
+#else
+    for (int channel = 0; channel < DSP_CHANNELS; channel ++)
+    {
+        double z1 = biquad.z1[channel];
+        double z2 = biquad.z2[channel];
+        for (int itx = 0; itx < frame_count; itx ++)
+        {
+            double* sample = this->block + itx * DSP_CHANNELS + channel;
+            double x = *sample;
+            double y = biquad.b0 * x + z1;
+            z1 = biquad.b1 * x - biquad.a1 * y + z2;
+            z2 = biquad.b2 * x - biquad.a2 * y;
+            *sample = y;
+        }
+        biquad.z1[channel] = z1;
+        biquad.z2[channel] = z2;
+    }
+#endif
+
+    for (int channel = 0; channel < DSP_CHANNELS; channel ++)
+    {
+        if (fabs(biquad.z1[channel]) < DSP_DENORMAL_THRESHOLD)
+            biquad.z1[channel] = 0;
+        if (fabs(biquad.z2[channel]) < DSP_DENORMAL_THRESHOLD)
+            biquad.z2[channel] = 0;
+    }
+}
+
+#ifdef __SSE2__
+static inline __m128i ShapeSamples(__m128d x, __m128d gain, bool soft_clip)
+{
+    x = _mm_mul_pd(x, gain);
+    if (soft_clip)
+    {
+        // Rational approximation of tanh, which reaches +/-1 at +/-3
+        x = _mm_min_pd(_mm_max_pd(x, _mm_set1_pd(-3)), _mm_set1_pd(3));
+        __m128d x2 = _mm_mul_pd(x, x);
+        x = _mm_div_pd(
+            _mm_mul_pd(x, _mm_add_pd(_mm_set1_pd(27), x2)),
+            _mm_add_pd(_mm_set1_pd(27), _mm_mul_pd(_mm_set1_pd(9), x2)));
+    }
+    x = _mm_min_pd(_mm_max_pd(x, _mm_set1_pd(-1)), _mm_set1_pd(1));
+    return _mm_cvtpd_epi32(_mm_mul_pd(x, _mm_set1_pd(32767)));
+}
+#endif
+
+static inline qint16 ShapeSample(double x, double gain, bool soft_clip)
+{
+    x *= gain;
+    if (soft_clip)
+    {
+        x = std::min(std::max(x, -3.0), 3.0);
+        x = x * (27 + x * x) / (27 + 9 * x * x);
+    }
+    x = std::min(std::max(x, -1.0), 1.0);
+    return (qint16)lrint(x * 32767);
+}
+
+void DspChain::StoreBlock(qint16* samples, int sample_count)
+{
+    int itx = 0;
+
+#ifdef __SSE2__
+    // Narrow 8 samples at a time back to 16-bit
+    __m128d gain = _mm_set1_pd(this->gain);
+    for (; itx + 8 <= sample_count; itx += 8)
+    {
+        __m128i low = _mm_unpacklo_epi64(
+            ShapeSamples(_mm_loadu_pd(this->block + itx), gain, this->soft_clip),
+            ShapeSamples(_mm_loadu_pd(this->block + itx + 2), gain, this->soft_clip));
+        __m128i high = _mm_unpacklo_epi64(
+            ShapeSamples(_mm_loadu_pd(this->block + itx + 4), gain, this->soft_clip),
+            ShapeSamples(_mm_loadu_pd(this->block + itx + 6), gain, this->soft_clip));
+        _mm_storeu_si128((__m128i*)(samples + itx), _mm_packs_epi32(low, high));
+    }
+#endif
+
+    for (; itx < sample_count; itx ++)
+        samples[itx] = ShapeSample(this->block[itx], this->gain, this->soft_clip);
+}
+
+DspChain::Biquad DspChain::MakeBiquad(double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    // Normalise, so that a0 is 1
+    Biquad biquad;
+    biquad.b0 = b0 / a0;
+    biquad.b1 = b1 / a0;
+    biquad.b2 = b2 / a0;
+    biquad.a1 = a1 / a0;
+    biquad.a2 = a2 / a0;
+    for (int channel = 0; channel < DSP_CHANNELS; channel ++)
+    {
+        biquad.z1[channel] = 0;
+        biquad.z2[channel] = 0;
+    }
+    return biquad;
+}
+
+// Filter coefficients are from the Audio EQ Cookbook (R. Bristow-Johnson)
+
+DspChain::Biquad DspChain::MakePeaking(double frequency, double gain, double q, int sample_rate)
+{
+    double a = pow(10, gain / 40);
+    double w0 = 2 * DSP_PI * frequency / sample_rate;
+    double alpha = sin(w0) / (2 * q);
+    return DspChain::MakeBiquad(
+        1 + alpha * a, -2 * cos(w0), 1 - alpha * a,
+        1 + alpha / a, -2 * cos(w0), 1 - alpha / a);
+}
+
+DspChain::Biquad DspChain::MakeLowShelf(double frequency, double gain, int sample_rate)
+{
+    // Shelf slope of 1
+    double a = pow(10, gain / 40);
+    double w0 = 2 * DSP_PI * frequency / sample_rate;
+    double cos_w0 = cos(w0);
+    double beta = sqrt(2 * a) * sin(w0);
+    return DspChain::MakeBiquad(
+        a * ((a + 1) - (a - 1) * cos_w0 + beta),
+        2 * a * ((a - 1) - (a + 1) * cos_w0),
+        a * ((a + 1) - (a - 1) * cos_w0 - beta),
+        (a + 1) + (a - 1) * cos_w0 + beta,
+        -2 * ((a - 1) + (a + 1) * cos_w0),
+        (a + 1) + (a - 1) * cos_w0 - beta);
+}
+
+DspChain::Biquad DspChain::MakeHighPass(double frequency, double q, int sample_rate)
+{
+    double w0 = 2 * DSP_PI * frequency / sample_rate;
+    double cos_w0 = cos(w0);
+    double alpha = sin(w0) / (2 * q);
+    return DspChain::MakeBiquad(
+        (1 + cos_w0) / 2, -(1 + cos_w0), (1 + cos_w0) / 2,
+        1 + alpha, -2 * cos_w0, 1 - alpha);
+}
+
+DspChain::Biquad DspChain::MakeLowPass(double frequency, double q, int sample_rate)
+{
+    double w0 = 2 * DSP_PI * frequency / sample_rate;
+    double cos_w0 = cos(w0);
+    double alpha = sin(w0) / (2 * q);
+    return DspChain::MakeBiquad(
+        (1 - cos_w0) / 2, 1 - cos_w0, (1 - cos_w0) / 2,
+        1 + alpha, -2 * cos_w0, 1 - alpha);
+}
+
+QString DspChain::GetImplementationName()
+{
+#ifdef __SSE2__
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+double DspChain::Benchmark(qint64 duration)
+{
+    // Full chain, as used for a station with the in-car sound
+    DspSettings settings;
+    DspBand bands[] = {{60, 3, 0.7}, {1000, -2, 1.0}, {8000, 4, 0.7}};
+    for (const DspBand& band : bands)
+        settings.bands.append(band);
+    settings.preamp = -3;
+    settings.bass_boost = 6;
+    settings.radio = true;
+    settings.soft_clip = true;
+    DspChain chain;
+    chain.Configure(settings, DSP_BENCHMARK_SAMPLE_RATE);
+
+    // A second of a tone with noise, which is processed repeatedly
+    QVector<qint16> samples(DSP_BENCHMARK_SAMPLE_RATE * DSP_CHANNELS);
+    quint32 noise = 1;
+    for (int itx = 0; itx < samples.count(); itx ++)
+    {
+        noise = noise * 1664525 + 10139;
+        double tone = sin(2 * DSP_PI * 440 * (itx / DSP_CHANNELS) / DSP_BENCHMARK_SAMPLE_RATE);
+        samples[itx] = (qint16)(tone * 16000 + (qint16)(noise >> 16) / 8);
+    }
+
+    qint64 frame_count = duration * DSP_BENCHMARK_SAMPLE_RATE / 1000;
+    QElapsedTimer timer;
+    timer.start();
+    for (qint64 processed = 0; processed < frame_count; processed += DSP_BENCHMARK_SAMPLE_RATE)
+        chain.Process(samples.data(), std::min(frame_count - processed, (qint64)DSP_BENCHMARK_SAMPLE_RATE));
+
+    return (timer.nsecsElapsed() / 1000000.0) / duration;
+}
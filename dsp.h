@@ -0,0 +1,106 @@
+#ifndef DSP_H
+#define DSP_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+
+// Settings for a station are read from '<station name>.dsp.ini',
+// alongside the station file.
+#define DSP_SETTINGS_SUFFIX ".dsp.ini"
+#define DSP_SETTINGS_GROUP "dsp"
+#define DSP_SETTINGS_KEY_PREAMP "preamp"
+#define DSP_SETTINGS_KEY_BASS_BOOST "bass_boost"
+#define DSP_SETTINGS_KEY_RADIO "radio"
+#define DSP_SETTINGS_KEY_SOFT_CLIP "soft_clip"
+#define DSP_SETTINGS_KEY_BANDS "eq"
+#define DSP_SETTINGS_KEY_BAND_FREQUENCY "frequency"
+#define DSP_SETTINGS_KEY_BAND_GAIN "gain"
+#define DSP_SETTINGS_KEY_BAND_Q "q"
+
+// Audio is processed in blocks of this many (stereo) frames
+#define DSP_BLOCK_FRAMES 256
+#define DSP_CHANNELS 2
+#define DSP_DEFAULT_Q 0.707
+// Corner frequency (Hz) of the bass boost shelf
+#define DSP_BASS_BOOST_FREQUENCY 100
+// Pass band (Hz) of the 'radio' filter
+#define DSP_RADIO_LOW_CUT 250
+#define DSP_RADIO_HIGH_CUT 5000
+// Amount of audio (ms) processed by the benchmark
+#define DSP_BENCHMARK_DURATION 600000
+
+// Equaliser band, boosting or cutting around a frequency
+struct DspBand
+{
+    double frequency;
+    // dB
+    double gain;
+    double q;
+};
+
+// Processing applied to a station
+struct DspSettings
+{
+    QList<DspBand> bands;
+    // Gains (dB)
+    double preamp;
+    double bass_boost;
+    // Band-pass, for the sound of a car radio
+    bool radio;
+    bool soft_clip;
+
+    DspSettings();
+    bool IsEnabled() const;
+
+    static DspSettings LoadForStation(QString station_file);
+};
+
+// Chain of biquad filters, followed by gain and an optional soft
+// clipper, applied in place to interleaved 16-bit stereo audio.
+// With SSE2, the left and right samples of each frame are filtered
+// together in a single register.
+class DspChain
+{
+
+public:
+    DspChain();
+
+    void Configure(const DspSettings& settings, int sample_rate);
+    bool IsEnabled();
+    void Reset();
+    void Process(qint16* samples, qint64 frame_count);
+
+    // Returns time taken to process audio, as a fraction of its duration
+    static double Benchmark(qint64 duration);
+    static QString GetImplementationName();
+
+private:
+    struct Biquad
+    {
+        double b0, b1, b2, a1, a2;
+        // Filter state for each channel
+        double z1[DSP_CHANNELS];
+        double z2[DSP_CHANNELS];
+    };
+
+    QVector<Biquad> biquads;
+    double gain;
+    bool soft_clip;
+    bool enabled;
+    // Samples of block being processed, scaled to -1..1
+    double block[DSP_BLOCK_FRAMES * DSP_CHANNELS];
+
+    void ProcessBlock(qint16* samples, int frame_count);
+    void LoadBlock(const qint16* samples, int sample_count);
+    void FilterBlock(Biquad& biquad, int frame_count);
+    void StoreBlock(qint16* samples, int sample_count);
+
+    static Biquad MakeBiquad(double b0, double b1, double b2, double a0, double a1, double a2);
+    static Biquad MakePeaking(double frequency, double gain, double q, int sample_rate);
+    static Biquad MakeLowShelf(double frequency, double gain, int sample_rate);
+    static Biquad MakeHighPass(double frequency, double q, int sample_rate);
+    static Biquad MakeLowPass(double frequency, double q, int sample_rate);
+};
+
+#endif // DSP_H
@@ -1,4 +1,4 @@
-QT       += core gui multimedia
+QT       += core gui multimedia network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -16,17 +16,58 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    broadcast.cpp \
+    dsp.cpp \
+    guide.cpp \
+    guidedialog.cpp \
     main.cpp \
     mainwindow.cpp \
-    player.cpp
+    metrics.cpp \
+    metricsserver.cpp \
+    mp3info.cpp \
+    pack.cpp \
+    player.cpp \
+    playercontroller.cpp \
+    schedule.cpp \
+    soak.cpp \
+    station.cpp \
+    stationdecoder.cpp \
+    streambuffer.cpp \
+    theme.cpp \
+    timeshift.cpp \
+    waveform.cpp \
+    waveformdialog.cpp \
+    zone.cpp
 
 HEADERS += \
+    broadcast.h \
+    dsp.h \
+    guide.h \
+    guidedialog.h \
     mainwindow.h \
-    player.h
+    metrics.h \
+    metricsserver.h \
+    mp3info.h \
+    pack.h \
+    player.h \
+    playercontroller.h \
+    schedule.h \
+    soak.h \
+    station.h \
+    stationdecoder.h \
+    streambuffer.h \
+    theme.h \
+    timeshift.h \
+    waveform.h \
+    waveformdialog.h \
+    zone.h
 
 FORMS += \
     mainwindow.ui
 
+RESOURCES += \
+    themes.qrc
+
 TRANSLATIONS += \
     gta-radio-player_en_GB.ts
 
@@ -0,0 +1,141 @@
+#include "guide.h"
+
+#include <algorithm>
+
+#include <QDateTime>
+#include <QFileInfo>
+
+#include "mainwindow.h"
+#include "mp3info.h"
+
+Guide::Guide(MainWindow* main_window, QObject* parent) : QObject(parent)
+{
+    this->main_window = main_window;
+    this->boundary_timer = new QTimer(this);
+    this->boundary_timer->setSingleShot(true);
+    QObject::connect(this->boundary_timer, SIGNAL(timeout()), this, SLOT(OnBoundary()));
+}
+
+void Guide::SetStations(QList<Station*> stations)
+{
+    this->stations = stations;
+    this->titles.clear();
+    this->Refresh();
+}
+
+void Guide::Refresh()
+{
+    // Work out every entry from scratch, e.g. after the timeline is reset
+    this->boundaries = std::priority_queue<Boundary, std::vector<Boundary>, std::greater<Boundary>>();
+    this->entries.resize(this->stations.count());
+
+    qint64 timeline_position = this->GetTimelinePosition();
+    for (int itx = 0; itx < this->stations.count(); itx ++)
+        this->UpdateEntry(itx, timeline_position);
+
+    this->StartBoundaryTimer();
+    emit this->Refreshed();
+}
+
+int Guide::GetEntryCount()
+{
+    return this->entries.count();
+}
+
+GuideEntry Guide::GetEntry(int station_index)
+{
+    return this->entries[station_index];
+}
+
+qint64 Guide::GetTimeRemaining(int station_index)
+{
+    if (this->entries[station_index].end < 0)
+        return -1;
+    return std::max(this->entries[station_index].end - this->GetTimelinePosition(), (qint64)0);
+}
+
+qint64 Guide::GetTimelinePosition()
+{
+    return QDateTime::currentMSecsSinceEpoch() - this->main_window->GetStartupTime();
+}
+
+void Guide::UpdateEntry(int station_index, qint64 timeline_position)
+{
+    Station* station = this->stations[station_index];
+    GuideEntry& entry = this->entries[station_index];
+    entry.station_name = station->GetName();
+    entry.live = station->IsStream();
+    entry.end = -1;
+
+    if (entry.live)
+    {
+        entry.title = station->GetName();
+        entry.next_title.clear();
+        return;
+    }
+
+    ScheduleItem item = station->GetSchedule()->GetItemAt(timeline_position);
+    ScheduleItem next_item = item;
+    if (item.end >= 0)
+    {
+        entry.end = item.end;
+        next_item = station->GetSchedule()->GetItemAt(item.end);
+    }
+    else if (station->GetDuration() > 0)
+    {
+        // Without interstitials, the station file just loops
+        entry.end = timeline_position - (timeline_position % station->GetDuration()) + station->GetDuration();
+    }
+
+    entry.title = this->GetItemTitle(station, item);
+    entry.next_title = entry.end < 0 ? QString() : this->GetItemTitle(station, next_item);
+
+    if (entry.end >= 0)
+        this->boundaries.push(qMakePair(entry.end, station_index));
+}
+
+void Guide::OnBoundary()
+{
+    // Only stations with a boundary that has passed are updated
+    qint64 timeline_position = this->GetTimelinePosition();
+    while (! this->boundaries.empty() && this->boundaries.top().first <= timeline_position)
+    {
+        int station_index = this->boundaries.top().second;
+        this->boundaries.pop();
+        this->UpdateEntry(station_index, timeline_position);
+        emit this->EntryChanged(station_index);
+    }
+
+    this->StartBoundaryTimer();
+}
+
+void Guide::StartBoundaryTimer()
+{
+    this->boundary_timer->stop();
+    if (this->boundaries.empty())
+        return;
+
+    qint64 interval = this->boundaries.top().first - this->GetTimelinePosition();
+    this->boundary_timer->start(std::min(std::max(interval, (qint64)0), (qint64)GUIDE_MAX_TIMER_INTERVAL));
+}
+
+QString Guide::GetItemTitle(Station* station, ScheduleItem item)
+{
+    // Station name is already taken from the tags of the station file
+    if (item.type == SCHEDULE_ITEM_MUSIC)
+        return station->GetName();
+    return this->GetTitle(item.file_path);
+}
+
+QString Guide::GetTitle(QString file_path)
+{
+    if (this->titles.contains(file_path))
+        return this->titles[file_path];
+
+    // Use title from tags, falling back to file name
+    QString title = Mp3Info(file_path).GetTitle();
+    if (title.isEmpty())
+        title = QFileInfo(file_path).completeBaseName();
+    this->titles[file_path] = title;
+    return title;
+}
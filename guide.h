@@ -0,0 +1,79 @@
+#ifndef GUIDE_H
+#define GUIDE_H
+
+#include <queue>
+#include <vector>
+#include <functional>
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+#include <QTimer>
+
+#include "station.h"
+#include "schedule.h"
+
+class MainWindow;
+
+// Longest time (ms) the boundary timer is set for, so that it is
+// re-armed after the timeline has been paused.
+#define GUIDE_MAX_TIMER_INTERVAL 60000
+
+// What is on air on a station
+struct GuideEntry
+{
+    QString station_name;
+    // Streams are live, so have no title or schedule
+    bool live;
+    QString title;
+    QString next_title;
+    // Timeline position at which the current item ends, or -1 if never
+    qint64 end;
+};
+
+// Guide of what is on air on every station, worked out from the
+// global timeline and each station's schedule, without loading media.
+// Entries are only updated when a boundary on their station passes,
+// using a queue ordered by the next boundary of each station.
+class Guide : public QObject
+{
+    Q_OBJECT
+
+public:
+    Guide(MainWindow* main_window, QObject* parent = nullptr);
+
+    void SetStations(QList<Station*> stations);
+    void Refresh();
+    int GetEntryCount();
+    GuideEntry GetEntry(int station_index);
+    qint64 GetTimeRemaining(int station_index);
+
+signals:
+    void EntryChanged(int station_index);
+    void Refreshed();
+
+private slots:
+    void OnBoundary();
+
+private:
+    typedef QPair<qint64, int> Boundary;
+
+    MainWindow* main_window;
+    QList<Station*> stations;
+    QVector<GuideEntry> entries;
+    std::priority_queue<Boundary, std::vector<Boundary>, std::greater<Boundary>> boundaries;
+    QTimer* boundary_timer;
+    // Titles of files, read from tags on first use
+    QHash<QString, QString> titles;
+
+    qint64 GetTimelinePosition();
+    void UpdateEntry(int station_index, qint64 timeline_position);
+    void StartBoundaryTimer();
+    QString GetItemTitle(Station* station, ScheduleItem item);
+    QString GetTitle(QString file_path);
+};
+
+#endif // GUIDE_H
@@ -0,0 +1,95 @@
+#include "guidedialog.h"
+
+#include <cstdio>
+
+#include <QVBoxLayout>
+#include <QHeaderView>
+#include <QStringList>
+
+GuideDialog::GuideDialog(Guide* guide, QWidget* parent) : QDialog(parent)
+{
+    this->guide = guide;
+    this->setWindowTitle("Now playing");
+    this->resize(600, 300);
+
+    this->table = new QTableWidget(0, GUIDE_COLUMN_COUNT, this);
+    this->table->setHorizontalHeaderLabels(QStringList() << "Station" << "Now" << "Remaining" << "Next");
+    this->table->horizontalHeader()->setStretchLastSection(true);
+    this->table->verticalHeader()->setVisible(false);
+    this->table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    this->table->setSelectionMode(QAbstractItemView::NoSelection);
+
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(this->table);
+
+    this->update_timer = new QTimer(this);
+    QObject::connect(this->update_timer, SIGNAL(timeout()), this, SLOT(UpdateRemaining()));
+
+    QObject::connect(this->guide, SIGNAL(Refreshed()), this, SLOT(Populate()));
+    QObject::connect(this->guide, SIGNAL(EntryChanged(int)), this, SLOT(UpdateRow(int)));
+    this->Populate();
+}
+
+void GuideDialog::showEvent(QShowEvent* event)
+{
+    QDialog::showEvent(event);
+
+    // Remaining times only need to count down whilst visible
+    this->UpdateRemaining();
+    this->update_timer->start(GUIDE_DIALOG_UPDATE_INTERVAL);
+}
+
+void GuideDialog::hideEvent(QHideEvent* event)
+{
+    QDialog::hideEvent(event);
+    this->update_timer->stop();
+}
+
+void GuideDialog::Populate()
+{
+    this->table->setRowCount(this->guide->GetEntryCount());
+    for (int itx = 0; itx < this->guide->GetEntryCount(); itx ++)
+        this->UpdateRow(itx);
+}
+
+void GuideDialog::UpdateRow(int station_index)
+{
+    if (station_index >= this->table->rowCount())
+        return;
+
+    GuideEntry entry = this->guide->GetEntry(station_index);
+    this->SetCell(station_index, GUIDE_COLUMN_STATION, entry.station_name);
+    this->SetCell(station_index, GUIDE_COLUMN_NOW, entry.title);
+    this->SetCell(station_index, GUIDE_COLUMN_NEXT, entry.next_title);
+    this->SetCell(station_index, GUIDE_COLUMN_REMAINING, entry.live ? "Live" : FormatDuration(this->guide->GetTimeRemaining(station_index)));
+}
+
+void GuideDialog::UpdateRemaining()
+{
+    for (int itx = 0; itx < this->table->rowCount(); itx ++)
+        if (! this->guide->GetEntry(itx).live)
+            this->SetCell(itx, GUIDE_COLUMN_REMAINING, FormatDuration(this->guide->GetTimeRemaining(itx)));
+}
+
+void GuideDialog::SetCell(int row, int column, QString text)
+{
+    QTableWidgetItem* item = this->table->item(row, column);
+    if (item == nullptr)
+    {
+        this->table->setItem(row, column, new QTableWidgetItem(text));
+        return;
+    }
+    if (item->text() != text)
+        item->setText(text);
+}
+
+QString GuideDialog::FormatDuration(qint64 duration)
+{
+    if (duration < 0)
+        return QString();
+
+    qint64 seconds = duration / 1000;
+    char text[32];
+    snprintf(text, sizeof(text), "%lld:%02lld", (long long)(seconds / 60), (long long)(seconds % 60));
+    return text;
+}
@@ -0,0 +1,49 @@
+#ifndef GUIDEDIALOG_H
+#define GUIDEDIALOG_H
+
+#include <QDialog>
+#include <QTableWidget>
+#include <QTimer>
+#include <QShowEvent>
+#include <QHideEvent>
+
+#include "guide.h"
+
+// Interval (ms) at which remaining times are updated whilst shown
+#define GUIDE_DIALOG_UPDATE_INTERVAL 1000
+
+enum GuideColumn {
+    GUIDE_COLUMN_STATION = 0,
+    GUIDE_COLUMN_NOW,
+    GUIDE_COLUMN_REMAINING,
+    GUIDE_COLUMN_NEXT
+};
+#define GUIDE_COLUMN_COUNT 4
+
+// Panel listing what is on air on every station, and what is next
+class GuideDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    GuideDialog(Guide* guide, QWidget* parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private slots:
+    void Populate();
+    void UpdateRow(int station_index);
+    void UpdateRemaining();
+
+private:
+    Guide* guide;
+    QTableWidget* table;
+    QTimer* update_timer;
+
+    void SetCell(int row, int column, QString text);
+    static QString FormatDuration(qint64 duration);
+};
+
+#endif // GUIDEDIALOG_H
@@ -1,16 +1,129 @@
 #include "mainwindow.h"
+#include "dsp.h"
+#include "soak.h"
+#include "broadcast.h"
+#include "pack.h"
+#include "streambuffer.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 #include <QApplication>
+#include <QTemporaryDir>
 
 int main(int argc, char *argv[])
 {
+    QString soak_directory;
+    int soak_retunes = SOAK_DEFAULT_RETUNES;
+    int soak_worker_threads = -1;
+    int soak_fixtures = 0;
+    QString load_test_url;
+    int load_test_clients = BROADCAST_LOAD_TEST_DEFAULT_CLIENTS;
+    int load_test_duration = BROADCAST_LOAD_TEST_DEFAULT_DURATION;
+    QString pack_directory;
+    QString stream_test_file;
+    QString pack_path;
+    for (int itx = 1; itx < argc; itx ++)
+    {
+        // Benchmark the DSP chain, without starting the player
+        if (strcmp(argv[itx], "--dsp-benchmark") == 0)
+        {
+            double cost = DspChain::Benchmark(DSP_BENCHMARK_DURATION);
+            std::cout << "DSP chain (" << DspChain::GetImplementationName().toStdString() << "): processed "
+                      << DSP_BENCHMARK_DURATION / 1000 << "s of audio in " << cost * DSP_BENCHMARK_DURATION << "ms ("
+                      << cost * 100 << "% of real time on one core)" << std::endl;
+            return 0;
+        }
+
+        // Soak test, re-tuning between stations of a directory,
+        // or between generated stations.
+        if (strcmp(argv[itx], "--soak") == 0 && itx + 1 < argc)
+            soak_directory = QString::fromLocal8Bit(argv[++ itx]);
+        else if (strcmp(argv[itx], "--soak-fixtures") == 0 && itx + 1 < argc)
+            soak_fixtures = std::max(atoi(argv[++ itx]), 2);
+        else if (strcmp(argv[itx], "--soak-retunes") == 0 && itx + 1 < argc)
+            soak_retunes = atoi(argv[++ itx]);
+        else if (strcmp(argv[itx], "--soak-worker-threads") == 0 && itx + 1 < argc)
+            soak_worker_threads = atoi(argv[++ itx]) ? 1 : 0;
+
+        // Load test of a broadcast server, without starting the player
+        else if (strcmp(argv[itx], "--broadcast-load-test") == 0 && itx + 1 < argc)
+            load_test_url = QString::fromLocal8Bit(argv[++ itx]);
+        else if (strcmp(argv[itx], "--load-test-clients") == 0 && itx + 1 < argc)
+            load_test_clients = std::max(atoi(argv[++ itx]), 1);
+        else if (strcmp(argv[itx], "--load-test-duration") == 0 && itx + 1 < argc)
+            load_test_duration = atoi(argv[++ itx]);
+
+        // Test a stream buffer against a local server, without starting the player
+        else if (strcmp(argv[itx], "--stream-test") == 0 && itx + 1 < argc)
+            stream_test_file = QString::fromLocal8Bit(argv[++ itx]);
+
+        // Pack the stations of a directory, without starting the player
+        else if (strcmp(argv[itx], "--pack") == 0 && itx + 2 < argc)
+        {
+            pack_directory = QString::fromLocal8Bit(argv[++ itx]);
+            pack_path = QString::fromLocal8Bit(argv[++ itx]);
+        }
+    }
+
+    if (! pack_directory.isEmpty())
+    {
+        // Decoding for loudness needs an application instance
+        QCoreApplication a(argc, argv);
+        if (! Pack::Write(pack_directory, pack_path))
+            return 1;
+
+        // Read back, to check the pack is complete
+        Pack pack(pack_path);
+        if (! pack.IsValid() || ! pack.GetVerification().result())
+        {
+            std::cout << "Pack: verification failed for " << pack_path.toStdString() << std::endl;
+            return 1;
+        }
+        std::cout << "Packed " << pack.GetStationCount() << " stations into " << pack_path.toStdString() << std::endl;
+        return 0;
+    }
+
+    if (! load_test_url.isEmpty())
+    {
+        QCoreApplication a(argc, argv);
+        BroadcastLoadTest load_test(QUrl(load_test_url), load_test_clients, load_test_duration);
+        load_test.Start();
+        return a.exec();
+    }
+
+    if (! stream_test_file.isEmpty())
+    {
+        QCoreApplication a(argc, argv);
+        StreamTest stream_test(stream_test_file);
+        stream_test.Start();
+        return a.exec();
+    }
+
     QApplication a(argc, argv);
     QCoreApplication::setAttribute(Qt::AA_DontUseNativeMenuBar);
 
+    QTemporaryDir soak_settings_directory;
+    QTemporaryDir soak_fixture_directory;
+    if (soak_fixtures > 0)
+    {
+        if (! Soak::WriteFixtures(soak_fixture_directory.path(), soak_fixtures))
+            return 1;
+        soak_directory = soak_fixture_directory.path();
+    }
+    if (! soak_directory.isEmpty())
+        Soak::PrepareSettings(soak_settings_directory.path(), soak_directory, soak_worker_threads);
+
     // Create instance of window and show
     MainWindow w;
     w.show();
 
+    Soak soak(&w, soak_retunes);
+    if (! soak_directory.isEmpty())
+        soak.Start();
+
     // Execute application and exit with response code
     return a.exec();
 }
@@ -1,6 +1,7 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include <QtConcurrent>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -11,7 +12,9 @@ MainWindow::MainWindow(QWidget *parent)
     QCoreApplication::setApplicationName("GTA Radio Player");
     this->setWindowTitle("GTA Radio Player");
 
-    this->settings = new QSettings(ORGANISATION, APP_NAME);
+    this->settings = new QSettings(QSettings::defaultFormat(), QSettings::UserScope, ORGANISATION, APP_NAME);
+    this->worker_threads = this->settings->value(SETTINGS_KEY_WORKER_THREADS, DEFAULT_WORKER_THREADS).toInt() == 1;
+    this->SetupMetrics();
 
     // Obtain config for 'always on top' and, if set, enable QT
     // window flag for always on top
@@ -22,19 +25,78 @@ MainWindow::MainWindow(QWidget *parent)
 
     // Create player objects and set current
     // player index to first player
-    this->players[0] = new Player;
-    this->players[0]->Setup(this, 1);
-    this->players[1] = new Player;
-    this->players[1]->Setup(this, 2);
+    this->players[0] = new PlayerController(1, this->worker_threads, this);
+    this->players[1] = new PlayerController(2, this->worker_threads, this);
+    QObject::connect(this->players[0], SIGNAL(SnapshotUpdated()), this, SLOT(PlayerUpdateSlot()));
+    QObject::connect(this->players[1], SIGNAL(SnapshotUpdated()), this, SLOT(PlayerUpdateSlot()));
     this->currentPlayerItx = 0;
+    this->currentStation = 0;
     this->pause_time = 0;
     this->is_playing = false;
+    this->low_power = false;
+    this->flipping = false;
+    this->next_item_prepared = false;
+    this->prepare_stage = PREPARE_STAGE_NONE;
+    this->prepare_command = 0;
+    this->retune_start = 0;
+    this->retune_prepare_duration = 0;
+    this->scanning = false;
+    this->scan_preparing = false;
+    this->scan_flip_pending = false;
+    this->scan_station = -1;
+    this->directory_station_index = 0;
+    this->release_command = 0;
+    this->scan_step = 0;
+    this->scan_preloaded_step = 0;
+    this->scan_pool.setMaxThreadCount(SCAN_PRELOAD_THREADS);
+    this->current_item.end = -1;
+    this->stationFileCount = 0;
+
+    // Timer for switching to the next item of the station schedule
+    this->schedule_timer = new QTimer(this);
+    this->schedule_timer->setSingleShot(true);
+    QObject::connect(this->schedule_timer, SIGNAL(timeout()), this, SLOT(ScheduleBoundarySlot()));
+
+    // Timer for ending the preview of each station whilst scanning
+    this->scan_timer = new QTimer(this);
+    this->scan_timer->setSingleShot(true);
+    QObject::connect(this->scan_timer, SIGNAL(timeout()), this, SLOT(ScanTimerSlot()));
+
+    // Timer for the re-tuning pause, once the new station has been prepared
+    this->retune_pause_timer = new QTimer(this);
+    this->retune_pause_timer->setSingleShot(true);
+    QObject::connect(this->retune_pause_timer, SIGNAL(timeout()), this, SLOT(RetunePauseSlot()));
+
+    // Guide is updated once stations have been loaded
+    this->guide = new Guide(this, this);
+
+    // Zones are restored once the initial station is playing
+    this->zone_manager = nullptr;
+    this->guide_dialog = nullptr;
+
+    // Waveforms are built once stations have been loaded
+    this->waveform_library = new WaveformLibrary(this);
+    this->waveform_dialog = nullptr;
+
+    // Broadcast server, if configured
+    this->broadcast_server = new BroadcastServer(this);
+    int broadcast_port = this->settings->value(SETTINGS_KEY_BROADCAST_PORT, DEFAULT_BROADCAST_PORT).toInt();
+    QHostAddress broadcast_address(this->settings->value(SETTINGS_KEY_BROADCAST_ADDRESS, DEFAULT_BROADCAST_ADDRESS).toString());
+    if (broadcast_port > 0)
+        this->broadcast_server->Listen(broadcast_address, broadcast_port);
+
+    // Timer for recording recent stations for time shift
+    this->time_shifted = false;
+    this->time_shift_timer = new QTimer(this);
+    QObject::connect(this->time_shift_timer, SIGNAL(timeout()), this, SLOT(RecordTimeShiftSlot()));
+    this->time_shift_timer->start(TIME_SHIFT_RECORD_INTERVAL);
 
     this->GetVolumeDial()->setValue(this->settings->value(SETTINGS_KEY_VOLUME, INITIAL_VOLUME).toInt());
     this->VolumeDialChangeSlot();
 
     // Set startup time
     this->SetStartupTime(false, 0);
+    this->broadcast_server->SetStartupTime(this->GetStartupTime());
 
     this->change_directory_action = new QAction(0);
     this->change_directory_action->setText("Change Directory");
@@ -47,34 +109,56 @@ MainWindow::MainWindow(QWidget *parent)
     this->always_on_top_action->setCheckable(true);
     this->always_on_top_action->setChecked(always_on_top_set);
 
+    this->scan_action = new QAction(0);
+    this->scan_action->setText("Scan stations");
+    this->scan_action->setCheckable(true);
+
+    this->guide_action = new QAction(0);
+    this->guide_action->setText("Now playing...");
+
+    this->waveform_action = new QAction(0);
+    this->waveform_action->setText("Waveform...");
+
     this->file_menu = new QMenu();
     this->file_menu->setTitle("File");
     this->file_menu->addAction(this->change_directory_action);
     this->file_menu->addAction(this->reset_global_timer);
+    this->file_menu->addAction(this->scan_action);
+    this->file_menu->addAction(this->guide_action);
+    this->file_menu->addAction(this->waveform_action);
     this->file_menu->addAction(this->always_on_top_action);
 
-    this->vice_theme_action = new QAction(0);
-    this->vice_theme_action->setText("Vice City");
-    this->vice_theme_action->setCheckable(true);
-
-    this->sa_theme_action = new QAction(0);
-    this->sa_theme_action->setText("San Andreas");
-    this->sa_theme_action->setCheckable(true);
-
-    this->plain_theme_action = new QAction(0);
-    this->plain_theme_action->setText("Plain");
-    this->plain_theme_action->setCheckable(true);
-
     this->theme_menu = new QMenu();
     this->theme_menu->setTitle("Theme");
-    this->theme_menu->addAction(this->vice_theme_action);
-    this->theme_menu->addAction(this->sa_theme_action);
-    this->theme_menu->addAction(this->plain_theme_action);
+    this->theme_action_group = new QActionGroup(this);
+    this->theme_action_group->setExclusive(true);
+    this->LoadThemes();
+
+    this->rewind_action = new QAction(0);
+    this->rewind_action->setText("Rewind 30 seconds");
+    this->live_action = new QAction(0);
+    this->live_action->setText("Return to live");
+    this->time_shift_menu = new QMenu();
+    this->time_shift_menu->setTitle("Time shift");
+    this->time_shift_menu->addAction(this->rewind_action);
+    this->time_shift_menu->addAction(this->live_action);
+
+    this->add_zone_action = new QAction(0);
+    this->add_zone_action->setText("Add zone...");
+    this->remove_zone_menu = new QMenu();
+    this->remove_zone_menu->setTitle("Remove zone");
+
+    this->zone_menu = new QMenu();
+    this->zone_menu->setTitle("Zones");
+    this->zone_menu->addAction(this->add_zone_action);
+    this->zone_menu->addMenu(this->remove_zone_menu);
 
     this->menu_bar = new QMenuBar(0);
     this->menu_bar->setNativeMenuBar(false);
     this->menu_bar->addMenu(this->file_menu);
     this->menu_bar->addMenu(this->theme_menu);
+    this->menu_bar->addMenu(this->time_shift_menu);
+    this->menu_bar->addMenu(this->zone_menu);
     this->setMenuBar(this->menu_bar);
 
     // Update UI theme to saved value (or default).
@@ -93,9 +177,14 @@ MainWindow::MainWindow(QWidget *parent)
     QObject::connect(this->change_directory_action, SIGNAL(triggered(bool)), this, SLOT(OpenChangeDirectory()));
     QObject::connect(this->reset_global_timer, SIGNAL(triggered(bool)), this, SLOT(ResetGlobalTimer()));
     QObject::connect(this->always_on_top_action, SIGNAL(toggled(bool)), this, SLOT(ToggleAlwaysOnTop(bool)));
-    QObject::connect(this->vice_theme_action, SIGNAL(triggered(bool)), this, SLOT(ViceThemeSelectSlot()));
-    QObject::connect(this->sa_theme_action, SIGNAL(triggered(bool)), this, SLOT(SaThemeSelectSlot()));
-    QObject::connect(this->plain_theme_action, SIGNAL(triggered(bool)), this, SLOT(PlainThemeSelectSlot()));
+    QObject::connect(this->theme_action_group, SIGNAL(triggered(QAction*)), this, SLOT(ThemeSelectSlot(QAction*)));
+    QObject::connect(this->rewind_action, SIGNAL(triggered(bool)), this, SLOT(RewindSlot()));
+    QObject::connect(this->live_action, SIGNAL(triggered(bool)), this, SLOT(ReturnToLiveSlot()));
+    QObject::connect(this->add_zone_action, SIGNAL(triggered(bool)), this, SLOT(AddZoneSlot()));
+    QObject::connect(this->remove_zone_menu, SIGNAL(triggered(QAction*)), this, SLOT(RemoveZoneSlot(QAction*)));
+    QObject::connect(this->scan_action, SIGNAL(triggered(bool)), this, SLOT(ScanSlot(bool)));
+    QObject::connect(this->guide_action, SIGNAL(triggered(bool)), this, SLOT(ShowGuideSlot()));
+    QObject::connect(this->waveform_action, SIGNAL(triggered(bool)), this, SLOT(ShowWaveformSlot()));
 
     // Select initial station.
     // This must be done after initial startup as MediaPlayer objects do not full function till
@@ -104,9 +193,50 @@ MainWindow::MainWindow(QWidget *parent)
         this->settings->value(SETTINGS_KEY_DIRECTORY, INITIAL_DIRECTORY).toString(),
         this->LoadCurrentStation());
     this->Play();
+
+    // Start zones that were playing when the application was closed
+    this->zone_manager = new ZoneManager(this->settings, this);
+    this->zone_manager->SetTimeline(this->GetTimelinePosition(), this->IsPlaying());
+    this->zone_manager->Restore(this->GetTimelinePosition());
+    this->UpdateZoneMenu();
+}
+
+void MainWindow::SetupMetrics()
+{
+    Metrics* metrics = Metrics::Instance();
+    this->retune_duration_metric = metrics->GetHistogram("gta_retune_duration_ms", "Total duration of changing station");
+    this->scan_duration_metric = metrics->GetHistogram("gta_scan_duration_ms", "Duration of scanning directory for stations");
+    this->files_scanned_metric = metrics->GetCounter("gta_files_scanned_total", "Files found whilst scanning for stations");
+    this->stations_metric = metrics->GetGauge("gta_stations", "Number of stations available");
+    this->paint_duration_metric = metrics->GetHistogram("gta_paint_duration_us", "Duration of repainting the window");
+    this->frame_latency_metric = metrics->GetHistogram("gta_gui_frame_latency_ms", "Lateness of GUI frames whilst re-tuning",
+                                                       this->worker_threads ? "players=\"threaded\"" : "players=\"gui\"");
+
+    // Ticks whilst re-tuning, to measure how long the GUI thread is blocked
+    this->frame_probe_timer = new QTimer(this);
+    this->frame_probe_timer->setTimerType(Qt::PreciseTimer);
+    QObject::connect(this->frame_probe_timer, SIGNAL(timeout()), this, SLOT(FrameProbeSlot()));
+
+    // Expose metrics over HTTP and/or to a file, if configured
+    this->metrics_server = new MetricsServer(this);
+    int metrics_port = this->settings->value(SETTINGS_KEY_METRICS_PORT, DEFAULT_METRICS_PORT).toInt();
+    if (metrics_port > 0)
+        this->metrics_server->Listen(metrics_port);
+
+    QString metrics_file = this->settings->value(SETTINGS_KEY_METRICS_FILE, "").toString();
+    if (! metrics_file.isEmpty())
+        this->metrics_server->StartFileDump(
+            metrics_file,
+            this->settings->value(SETTINGS_KEY_METRICS_FILE_INTERVAL, DEFAULT_METRICS_FILE_INTERVAL).toInt());
 }
 
 void MainWindow::PlayPauseButtonSlot() {
+    // Any input stops a scan on the current station
+    if (this->scanning) {
+        this->StopScan();
+        return;
+    }
+
     if (this->IsPlaying()) {
         this->Pause();
     } else {
@@ -114,17 +244,29 @@ void MainWindow::PlayPauseButtonSlot() {
     }
 }
 
-void MainWindow::ViceThemeSelectSlot()
-{
-    this->SetTheme(THEME_VICE);
-}
-void MainWindow::SaThemeSelectSlot()
+void MainWindow::LoadThemes()
 {
-    this->SetTheme(THEME_SA);
+    // Palettes for themes are painted with Fusion, as native
+    // styles may ignore button and dial colours.
+    this->themed_style = QStyleFactory::create("Fusion");
+
+    // Load bundled themes, then user themes, which may override them
+    this->theme_library.Load(THEME_RESOURCE_FILE);
+    this->theme_library.Load(QFileInfo(this->settings->fileName()).absolutePath() + "/" + THEME_USER_FILE_NAME);
+
+    QList<Theme> themes = this->theme_library.GetThemes();
+    for (int itx = 0; itx < themes.count(); itx ++)
+    {
+        QAction* action = new QAction(themes[itx].name, this->theme_action_group);
+        action->setCheckable(true);
+        action->setData(themes[itx].id);
+        this->theme_menu->addAction(action);
+    }
 }
-void MainWindow::PlainThemeSelectSlot()
+
+void MainWindow::ThemeSelectSlot(QAction* action)
 {
-    this->SetTheme(THEME_PLAIN);
+    this->SetTheme(action->data().toString());
 }
 
 void MainWindow::SetTheme(QString theme_name)
@@ -138,94 +280,230 @@ void MainWindow::UpdateUiTheme(QString theme_name)
 {
     std::cout << "Setting theme to: " << theme_name.toStdString() << std::endl;
 
-    // Deselect all UI Theme buttons
-    this->vice_theme_action->setChecked(false);
-    this->sa_theme_action->setChecked(false);
-    this->plain_theme_action->setChecked(false);
+    Theme theme;
+    if (! this->theme_library.GetTheme(theme_name, theme))
+    {
+        this->DisplayError("Unkown theme");
+        return;
+    }
+
+    // Select UI Theme button for theme
+    QList<QAction*> theme_actions = this->theme_action_group->actions();
+    for (int itx = 0; itx < theme_actions.count(); itx ++)
+        theme_actions[itx]->setChecked(theme_actions[itx]->data().toString() == theme.id);
+
+    // Only change style when switching between plain and styled themes,
+    // as this re-polishes the widget.
+    QStyle* style = theme.styled ? this->themed_style : QApplication::style();
+    QWidget* styled_widgets[] = {
+        this->GetMuteButton(),
+        this->GetPlayPauseButton(),
+        this->GetNextButton(),
+        this->GetPreviousButton(),
+        this->GetVolumeDial()
+    };
+    for (QWidget* widget : styled_widgets)
+        if (widget->style() != style)
+            widget->setStyle(style);
+
+    // Swap palettes
+    this->GetBackgroundWidget()->setAutoFillBackground(theme.styled);
+    this->GetBackgroundWidget()->setPalette(theme.window_palette);
+    this->GetMuteButton()->setPalette(theme.button_palette);
+    this->GetPlayPauseButton()->setPalette(theme.button_palette);
+    this->GetNextButton()->setPalette(theme.button_palette);
+    this->GetPreviousButton()->setPalette(theme.button_palette);
+    this->GetVolumeDial()->setPalette(theme.dial_palette);
+
+    this->GetDisplayBackgroundWidget()->setAutoFillBackground(theme.styled);
+    this->GetDisplayBackgroundWidget()->setPalette(theme.display_background_palette);
+    this->GetDisplay()->setAutoFillBackground(theme.styled);
+    this->GetDisplay()->setPalette(theme.station_palette);
+    this->GetDisplay()->setMargin(theme.display_margin);
+    this->GetPositionLabel()->setAutoFillBackground(theme.styled);
+    this->GetPositionLabel()->setPalette(theme.position_palette);
+    this->GetPositionLabel()->setMargin(theme.display_margin);
+}
+
+bool MainWindow::event(QEvent *event)
+{
+    // The whole window is repainted whilst handling the update request
+    if (event->type() != QEvent::UpdateRequest)
+        return QMainWindow::event(event);
+
+    QElapsedTimer paint_timer;
+    paint_timer.start();
+    bool result = QMainWindow::event(event);
+    this->paint_duration_metric->Record(paint_timer.nsecsElapsed() / 1000);
+    return result;
+}
+
+void MainWindow::UpdateRecentStations(Station* station)
+{
+    // Record the current station, and a few previous stations, so
+    // that switching back to a station can still rewind.
+    this->recent_stations.removeAll(station);
+    this->recent_stations.prepend(station);
+    station->EnableTimeShift(this->settings->value(SETTINGS_KEY_TIME_SHIFT_DURATION, TIME_SHIFT_DEFAULT_DURATION).toLongLong());
+
+    while (this->recent_stations.count() > TIME_SHIFT_RECENT_STATIONS)
+        this->recent_stations.takeLast()->DisableTimeShift();
+
+    this->RecordTimeShiftSlot();
+}
 
-    if (theme_name.toStdString() == THEME_VICE)
+void MainWindow::RecordTimeShiftSlot()
+{
+    qint64 timeline_position = this->GetTimelinePosition();
+    for (int itx = 0; itx < this->recent_stations.count(); itx ++)
+        this->recent_stations[itx]->UpdateTimeShift(timeline_position);
+}
+
+void MainWindow::RewindSlot()
+{
+    this->StopScan();
+    if (! this->IsPlayAvailable() || this->flipping)
+        return;
+
+    // Already rewound, so just move back through the buffer
+    if (this->GetCurrentPlayer()->IsTimeShifted())
     {
-        this->vice_theme_action->setChecked(true);
-
-        // Set background colour of display label
-        this->GetDisplay()->setStyleSheet("QLabel {"
-                                            "margin: 1px;"
-                                          "}");
-        this->GetPositionLabel()->setStyleSheet("QLabel {"
-                                          "margin: 1px;"
-                                          "}");
-        this->GetDisplayBackgroundWidget()->setStyleSheet(
-            "QWidget {"
-                //"background-color: #70ffdf;"
-                //"color: #ff4df0;"
-                  "background-color: #000012;"
-                  "color: #ff4df0;"
-            "}");
-        this->GetBackgroundWidget()->setStyleSheet(
-            "QWidget {"
-              "background-color: #1d269b;"
-            "}"
-            "QPushButton {"
-              "background-color: #9d4dff;"
-              "color: #70ffdf;"
-//              "background-color: #ffffff;"
-//              "color: #ff4df0;"
-            "}"
-            "QDial {"
-              "background-color: #ff4df0;"
-            "}"
-        );
+        this->GetCurrentPlayer()->Rewind(TIME_SHIFT_REWIND_STEP);
+        return;
     }
 
-    else if (theme_name.toStdString() == THEME_SA)
+    TimeShiftBuffer* buffer = this->stations[this->currentStation]->GetTimeShiftBuffer();
+    if (buffer == nullptr || buffer->GetSize() == 0)
+        return;
+
+    // Switch to playing from the buffer, in the other player
+    this->flipping = true;
+    this->schedule_timer->stop();
+    this->DisableMediaButtons();
+
+    this->StartPrepare(PREPARE_STAGE_REWIND,
+                       this->GetNextPlayer()->PrepareFlipTo(new TimeShiftReader(buffer, TIME_SHIFT_REWIND_STEP)));
+}
+
+void MainWindow::FinishRewindPrepare(bool prepared)
+{
+    this->flipping = false;
+    this->EnableMediaButtons();
+
+    if (! prepared)
+    {
+        // Carry on playing live
+        this->StartScheduleTimer();
+        return;
+    }
+
+    bool was_playing = this->IsPlaying();
+    this->GetCurrentPlayer()->FlipFrom(was_playing);
+    this->currentPlayerItx = this->currentPlayerItx ? 0 : 1;
+    this->GetCurrentPlayer()->FlipTo(was_playing);
+    this->time_shifted = true;
+}
+
+void MainWindow::ReturnToLiveSlot()
+{
+    this->StopScan();
+    if (! this->time_shifted || this->flipping)
+        return;
+
+    // Re-tune to the station, which returns to the global timeline
+    this->SelectStation(this->currentStation);
+}
+
+void MainWindow::AddZoneSlot()
+{
+    bool ok;
+    QString device_name = QInputDialog::getItem(
+        this, "Add zone", "Output device:", ZoneManager::GetDeviceNames(), 0, false, &ok);
+    if (! ok)
+        return;
+
+    // Zones decode station files directly, so streams and packed stations are not available
+    QStringList station_names;
+    QStringList station_files;
+    for (int itx = 0; itx < this->stationFileCount; itx ++)
     {
-        this->sa_theme_action->setChecked(true);
-
-        // Set background colour of display label
-        this->GetDisplay()->setStyleSheet("QLabel {"
-                                            "background-color: #000000;"
-                                            "margin: 1px;"
-                                            "color: #20d633;"
-                                          "}");
-        this->GetPositionLabel()->setStyleSheet("QLabel {"
-                                          "background-color: #000012;"
-                                          "margin: 1px;"
-                                          "color: #20d633;"
-                                          "}");
-        this->GetDisplayBackgroundWidget()->setStyleSheet("QWidget {"
-                                                            "background-color: #000012;"
-                                                          "}");
-        this->GetBackgroundWidget()->setStyleSheet(
-            "QWidget {"
-              "background-color: #000000;"
-            "}"
-            "QPushButton {"
-              "background-color: #000000;"
-              "color: #eeeeee;"
-    //          "border-style: solid;"
-    //          "border-width: 1px;"
-    //          "border-color: red;"
-            "}"
-            "QDial {"
-              "background-color: #000000;"
-            "}"
-        );
+        if (this->stations[itx]->IsStream() || this->stations[itx]->IsPacked())
+            continue;
+        station_names << this->stations[itx]->GetName();
+        station_files << this->stations[itx]->GetFilePath();
     }
-    else if (theme_name == THEME_PLAIN)
+    if (station_files.isEmpty())
     {
-        this->plain_theme_action->setChecked(true);
+        this->DisplayError("No stations available for zones.");
+        return;
+    }
 
-        // Set background colour of display label
-        this->GetDisplay()->setStyleSheet("");
-        this->GetPositionLabel()->setStyleSheet("");
-        this->GetDisplayBackgroundWidget()->setStyleSheet("");
-        this->GetBackgroundWidget()->setStyleSheet("");
+    QString station_name = QInputDialog::getItem(this, "Add zone", "Station:", station_names, 0, false, &ok);
+    if (! ok)
+        return;
 
-    } else {
-        this->DisplayError("Unkown theme");
+    this->zone_manager->AddZone(
+        device_name,
+        station_files[station_names.indexOf(station_name)],
+        this->GetVolumeDial()->value(),
+        this->GetTimelinePosition());
+    this->zone_manager->Save();
+    this->UpdateZoneMenu();
+}
+
+void MainWindow::RemoveZoneSlot(QAction* action)
+{
+    this->zone_manager->RemoveZone(action->data().toInt());
+    this->zone_manager->Save();
+    this->UpdateZoneMenu();
+}
+
+void MainWindow::UpdateZoneMenu()
+{
+    this->remove_zone_menu->clear();
+    QList<Zone*> zones = this->zone_manager->GetZones();
+    for (int itx = 0; itx < zones.count(); itx ++)
+    {
+        QAction* action = this->remove_zone_menu->addAction(
+            zones[itx]->GetDeviceName() + ": " + QFileInfo(zones[itx]->GetStationFile()).completeBaseName());
+        action->setData(itx);
     }
+    this->remove_zone_menu->setEnabled(! zones.isEmpty());
 }
 
+void MainWindow::changeEvent(QEvent *event)
+{
+    QMainWindow::changeEvent(event);
+    if (event->type() == QEvent::WindowStateChange)
+        this->UpdatePowerMode();
+}
+
+void MainWindow::showEvent(QShowEvent *event)
+{
+    QMainWindow::showEvent(event);
+    this->UpdatePowerMode();
+}
+
+void MainWindow::hideEvent(QHideEvent *event)
+{
+    QMainWindow::hideEvent(event);
+    this->UpdatePowerMode();
+}
+
+void MainWindow::UpdatePowerMode()
+{
+    // Whilst the window cannot be seen, there is no need to update
+    // any of the UI, so drop players into low power mode.
+    // When paused, the backend stops position notifications itself.
+    bool low_power = this->isMinimized() || ! this->isVisible();
+    if (low_power == this->low_power)
+        return;
+
+    this->low_power = low_power;
+    std::cout << "Low power mode: " << (low_power ? "on" : "off") << std::endl;
+    this->players[0]->SetLowPowerMode(low_power);
+    this->players[1]->SetLowPowerMode(low_power);
+}
 
 qint64 MainWindow::GetStartupTime()
 {
@@ -238,10 +516,61 @@ qint64 MainWindow::GetStartupTime()
 
 void MainWindow::UpdateDirectory(QString new_directory, int station_index)
 {
+    // Stations cannot be removed whilst a player is still loading one
+    if (this->flipping || this->scan_preparing)
+    {
+        this->DisplayError("Unable to change directory whilst re-tuning");
+        return;
+    }
+
+    this->StopScan();
     this->settings->setValue(SETTINGS_KEY_DIRECTORY, new_directory);
     this->scan_directory = new_directory;
+    this->directory_station_index = station_index;
+
+    // Nothing holds stations on startup, so they are scanned straight away
+    if (this->stationFileCount == 0)
+        this->FinishDirectoryUpdate();
+    else
+        this->ReleaseStations();
+}
+
+void MainWindow::ReleaseStations()
+{
+    // Players release streams, packs and time shift buffers of the old
+    // stations before they are deleted. The next player may hold a
+    // station prepared for the schedule or a scan. Until both players
+    // have caught up, nothing may use the stations, so controls and
+    // timers are stopped and the stations are removed from everything
+    // that reads them.
+    this->flipping = true;
+    this->DisableMediaButtons();
+    this->SetStationActionsEnabled(false);
+    this->SetDisplay("Scanning...");
+    this->schedule_timer->stop();
+    this->time_shift_timer->stop();
+    this->next_item_prepared = false;
+    this->recent_stations.clear();
+    this->time_shifted = false;
+    this->guide->SetStations(QList<Station*>());
+    this->broadcast_server->SetStations(QList<Station*>());
+    this->waveform_library->SetStations(QList<Station*>());
+
+    this->GetCurrentPlayer()->FlipFrom(true);
+    this->GetNextPlayer()->FlipFrom(false);
+    this->release_command = this->GetCurrentPlayer()->Sync();
+    this->StartPrepare(PREPARE_STAGE_RELEASE, this->GetNextPlayer()->Sync());
+}
+
+void MainWindow::FinishDirectoryUpdate()
+{
     this->PopulateFileList();
+    this->flipping = false;
+    this->SetStationActionsEnabled(true);
+    this->EnableMediaButtons();
+    this->time_shift_timer->start(TIME_SHIFT_RECORD_INTERVAL);
 
+    int station_index = this->directory_station_index;
     if (station_index >= this->stationFileCount)
     {
         std::cout << "Warning: Requested station index: " << station_index <<
@@ -255,6 +584,15 @@ void MainWindow::UpdateDirectory(QString new_directory, int station_index)
         this->DisablePlayer();
 }
 
+void MainWindow::SetStationActionsEnabled(bool enabled)
+{
+    this->change_directory_action->setEnabled(enabled);
+    this->reset_global_timer->setEnabled(enabled);
+    this->rewind_action->setEnabled(enabled);
+    this->live_action->setEnabled(enabled);
+    this->scan_action->setEnabled(enabled);
+}
+
 void MainWindow::DisablePlayer()
 {
     this->SetDisplay("No tracks found...");
@@ -268,6 +606,11 @@ void MainWindow::Pause()
     this->is_playing = false;
     this->pause_time = QDateTime::currentMSecsSinceEpoch();
     this->GetCurrentPlayer()->Pause();
+
+    // Timeline does not move whilst paused
+    this->schedule_timer->stop();
+    if (this->zone_manager != nullptr)
+        this->zone_manager->SetTimeline(this->GetTimelinePosition(), false);
 }
 
 void MainWindow::OpenChangeDirectory()
@@ -287,13 +630,22 @@ void MainWindow::OpenChangeDirectory()
 
 void MainWindow::ResetGlobalTimer()
 {
+    this->StopScan();
     this->SetStartupTime(true, 0);
+    this->broadcast_server->SetStartupTime(this->GetStartupTime());
+    this->guide->Refresh();
+    this->zone_manager->SetTimeline(this->GetTimelinePosition(), this->IsPlaying());
 
     // Restart current station
     if (! this->IsPlayAvailable())
         return;
 
-    this->GetCurrentPlayer()->SetPosition();
+    // If the station has a schedule, the item on air will have changed,
+    // so re-tune to the station.
+    if (this->stations[this->currentStation]->GetSchedule()->HasInterstitials())
+        this->SelectStation(this->currentStation);
+    else
+        this->GetCurrentPlayer()->SetPosition();
 }
 
 void MainWindow::SetStartupTime(bool force_reset, qint64 new_time)
@@ -316,11 +668,11 @@ void MainWindow::ToggleAlwaysOnTop(bool new_value)
     this->DisplayInfo("Application must be restarted for changes to take effect.");
 }
 
-Player* MainWindow::GetCurrentPlayer()
+PlayerController* MainWindow::GetCurrentPlayer()
 {
     return this->players[this->currentPlayerItx];
 }
-Player* MainWindow::GetNextPlayer()
+PlayerController* MainWindow::GetNextPlayer()
 {
     return this->players[this->currentPlayerItx ? 0 : 1];
 }
@@ -328,7 +680,8 @@ Player* MainWindow::GetNextPlayer()
 
 void MainWindow::MuteButtonSlot()
 {
-    if (this->GetCurrentPlayer()->GetMediaPlayer()->isMuted())
+    this->StopScan();
+    if (this->GetCurrentPlayer()->IsMuted())
     {
         this->SetMute(false);
         this->GetMuteButton()->setText(MUTE_BUTTON_TEXT_MUTE);
@@ -338,6 +691,46 @@ void MainWindow::MuteButtonSlot()
     }
 }
 
+Guide* MainWindow::GetGuide()
+{
+    return this->guide;
+}
+
+Station* MainWindow::GetCurrentStation()
+{
+    if (this->currentStation < 0 || this->currentStation >= this->stationFileCount)
+        return nullptr;
+    return this->stations[this->currentStation];
+}
+
+void MainWindow::ShowWaveformSlot()
+{
+    if (this->waveform_dialog == nullptr)
+        this->waveform_dialog = new WaveformDialog(this->waveform_library, this, this);
+    this->waveform_dialog->show();
+    this->waveform_dialog->raise();
+    this->waveform_dialog->activateWindow();
+}
+
+void MainWindow::ShowGuideSlot()
+{
+    if (this->guide_dialog == nullptr)
+        this->guide_dialog = new GuideDialog(this->guide, this);
+    this->guide_dialog->show();
+    this->guide_dialog->raise();
+    this->guide_dialog->activateWindow();
+}
+
+MetricsHistogram* MainWindow::GetFrameLatencyMetric()
+{
+    return this->frame_latency_metric;
+}
+
+int MainWindow::GetStationCount()
+{
+    return this->stationFileCount;
+}
+
 bool MainWindow::IsPlayAvailable()
 {
     return (this->stationFileCount > 0);
@@ -390,14 +783,17 @@ void MainWindow::Play()
 
     this->is_playing = true;
     this->GetCurrentPlayer()->Play();
+    this->StartScheduleTimer();
+    if (this->zone_manager != nullptr)
+        this->zone_manager->SetTimeline(this->GetTimelinePosition(), true);
 
     this->GetPlayPauseButton()->setText("Pause");
 }
 
 void MainWindow::SetMute(bool muted)
 {
-    this->GetCurrentPlayer()->GetMediaPlayer()->setMuted(muted);
-    this->GetNextPlayer()->GetMediaPlayer()->setMuted(muted);
+    this->GetCurrentPlayer()->SetMuted(muted);
+    this->GetNextPlayer()->SetMuted(muted);
 }
 
 void MainWindow::NextStation()
@@ -405,6 +801,13 @@ void MainWindow::NextStation()
     if (! this->IsPlayAvailable())
         return;
 
+    // Stop on the station being scanned, rather than moving on
+    if (this->scanning)
+    {
+        this->StopScan();
+        return;
+    }
+
     // If end of station index, start from 0
     this->SelectStation((this->currentStation == (this->stationFileCount - 1)) ? 0 : this->currentStation + 1);
 }
@@ -414,6 +817,12 @@ void MainWindow::PreviousStation()
     if (! this->IsPlayAvailable())
         return;
 
+    if (this->scanning)
+    {
+        this->StopScan();
+        return;
+    }
+
     this->SelectStation(
         (this->currentStation == 0) ? (this->stationFileCount - 1) : (this->    currentStation - 1)
     );
@@ -444,50 +853,403 @@ void MainWindow::SaveCurrentStation()
     this->settings->setValue(SETTINGS_KEY_CURRENT_STATION_INDEX, this->currentStation);
 }
 
-void MainWindow::SelectStation(int station_index)
+bool MainWindow::SelectStation(int station_index)
 {
+    // A station being prepared for the schedule is superseded by the
+    // new station, but any other change must finish first.
+    if (this->flipping && this->prepare_stage != PREPARE_STAGE_SCHEDULE)
+        return false;
+
     this->DisableMediaButtons();
 
     if (station_index >= this->stationFileCount)
     {
         this->DisplayError("Station ID out of range");
         this->EnableMediaButtons();
-        return;
+        return false;
     }
 
+    this->flipping = true;
+    this->schedule_timer->stop();
+    this->frame_probe_clock.start();
+    this->frame_probe_timer->start(FRAME_PROBE_INTERVAL);
     this->currentStation = station_index;
     this->SaveCurrentStation();
+    this->UpdateRecentStations(this->stations[station_index]);
 
     this->SetDisplay("Re-tuning...");
     // Set start time before performing any media swapping, so that
     // if the media loading takes some time, the amount of time
     // held in artificial 're-tuning' loop compensates for this.
-    qint64 start_pause = QDateTime::currentMSecsSinceEpoch();
+    this->retune_start = QDateTime::currentMSecsSinceEpoch();
+
+    // Obtain item of station schedule that will be on air once
+    // the re-tuning pause has finished.
+    this->retune_item = this->GetScheduleItemAt(this->GetTimelinePosition() + STATION_CHANGE_DRAMATIC_PAUSE_DURATION);
+    this->StartPrepare(PREPARE_STAGE_SELECT,
+                       this->PrepareScheduleItem(this->GetNextPlayer(), this->stations[station_index], this->retune_item));
+    return true;
+}
+
+void MainWindow::StartPrepare(PrepareStage stage, int command)
+{
+    // Continued by PlayerUpdateSlot, once the next player has loaded the station
+    this->prepare_stage = stage;
+    this->prepare_command = command;
+}
 
-    this->GetNextPlayer()->PrepareFlipTo(QUrl::fromLocalFile(this->stationFiles[station_index]));
+void MainWindow::PlayerUpdateSlot()
+{
+    if (this->prepare_stage == PREPARE_STAGE_NONE || ! this->GetNextPlayer()->IsCommandComplete(this->prepare_command))
+        return;
+    // Releasing stations waits for both players
+    if (this->prepare_stage == PREPARE_STAGE_RELEASE && ! this->GetCurrentPlayer()->IsCommandComplete(this->release_command))
+        return;
+
+    PrepareStage stage = this->prepare_stage;
+    bool prepared = ! this->GetNextPlayer()->HasCommandFailed(this->prepare_command);
+    this->prepare_stage = PREPARE_STAGE_NONE;
+    if (stage == PREPARE_STAGE_SELECT)
+        this->FinishSelectPrepare(prepared);
+    else if (stage == PREPARE_STAGE_SCHEDULE)
+        this->FinishSchedulePrepare(prepared);
+    else if (stage == PREPARE_STAGE_SCAN)
+        this->FinishScanPrepare(prepared);
+    else if (stage == PREPARE_STAGE_REWIND)
+        this->FinishRewindPrepare(prepared);
+    else if (stage == PREPARE_STAGE_RELEASE)
+        this->FinishDirectoryUpdate();
+}
+
+void MainWindow::FinishSelectPrepare(bool prepared)
+{
+    this->retune_prepare_duration = QDateTime::currentMSecsSinceEpoch() - this->retune_start;
 
     // Pause old player, start new one and flip
-    bool was_playing = this->IsPlaying();
-    this->GetCurrentPlayer()->FlipFrom(was_playing);
+    this->GetCurrentPlayer()->FlipFrom(this->IsPlaying());
+
+    if (! prepared)
+    {
+        // Stay silent on the station, as a radio would, until another is selected
+        std::cout << "Unable to tune station: " << this->currentStation << std::endl;
+        this->SetDisplay("Unable to tune");
+        this->current_item.end = -1;
+        this->flipping = false;
+        this->EnableMediaButtons();
+        this->frame_probe_timer->stop();
+        emit RetuneFinished(false, this->retune_prepare_duration);
+        return;
+    }
 
     // Pause for dramatic effect!
-    while (QDateTime::currentMSecsSinceEpoch() < (start_pause + STATION_CHANGE_DRAMATIC_PAUSE_DURATION))
-        QCoreApplication::processEvents(QEventLoop::AllEvents, 100);
+    qint64 pause_remaining = this->retune_start + STATION_CHANGE_DRAMATIC_PAUSE_DURATION - QDateTime::currentMSecsSinceEpoch();
+    this->retune_pause_timer->start(std::max(pause_remaining, (qint64)0));
+}
 
+void MainWindow::RetunePauseSlot()
+{
+    int station_index = this->currentStation;
     this->currentPlayerItx = this->currentPlayerItx ? 0 : 1;
 
     // Flip to new player (note now GetCurrentPlayer since currentPlayerItx has now been updated).
+    this->GetCurrentPlayer()->FlipTo(this->IsPlaying());
+    this->current_item = this->retune_item;
+    this->time_shifted = false;
+
+    if (this->current_item.type == SCHEDULE_ITEM_MUSIC && ! this->stations[station_index]->IsStream() && ! this->stations[station_index]->IsPacked())
+        this->SetDisplay(this->GetMediaName());
+    else
+        this->SetDisplay(this->stations[station_index]->GetName());
+    this->flipping = false;
+    this->StartScheduleTimer();
+    this->EnableMediaButtons();
+
+    this->frame_probe_timer->stop();
+    this->retune_duration_metric->Record(QDateTime::currentMSecsSinceEpoch() - this->retune_start);
+    emit RetuneFinished(true, this->retune_prepare_duration);
+}
+
+void MainWindow::FrameProbeSlot()
+{
+    // Record how much later than expected the timer fired
+    qint64 elapsed = this->frame_probe_clock.restart();
+    this->frame_latency_metric->Record(std::max(elapsed - FRAME_PROBE_INTERVAL, (qint64)0));
+}
+
+qint64 MainWindow::GetTimelinePosition()
+{
+    return QDateTime::currentMSecsSinceEpoch() - this->GetStartupTime();
+}
+
+ScheduleItem MainWindow::GetScheduleItemAt(qint64 timeline_position)
+{
+    return this->stations[this->currentStation]->GetSchedule()->GetItemAt(timeline_position);
+}
+
+int MainWindow::PrepareScheduleItem(PlayerController* player, Station* station, ScheduleItem item, bool known_duration)
+{
+    // Music is the station file, which loops on the global timeline,
+    // whereas interstitials play once from the start of the item.
+    // Streams are live, so are just played from the buffer, and packed
+    // stations are read from the pack at the position of the timeline.
+    // Durations read from the files are only trusted when the player
+    // must be ready quickly (scanning); otherwise the player probes the
+    // backend for them, as it reports the duration it will loop on.
+    if (station->IsStream())
+        return player->PrepareFlipTo(station->GetStreamBuffer());
+    else if (station->IsPacked())
+        return player->PrepareFlipTo(new PackReader(station->GetPack(), station->GetPackIndex()));
+    else if (item.type == SCHEDULE_ITEM_MUSIC)
+        return player->PrepareFlipTo(QUrl::fromLocalFile(station->GetFilePath()), -1, known_duration ? station->GetDuration() : 0);
+    else
+        return player->PrepareFlipTo(QUrl::fromLocalFile(item.file_path), item.start, known_duration ? item.end - item.start : 0);
+}
+
+void MainWindow::StartScheduleTimer()
+{
+    this->schedule_timer->stop();
+    this->next_item_prepared = false;
+
+    // Nothing to switch to if the item never ends, or whilst paused,
+    // as the timeline does not move.
+    if (this->current_item.end < 0 || ! this->IsPlaying())
+        return;
+
+    qint64 time_to_prepare = this->current_item.end - this->GetTimelinePosition() - SCHEDULE_PREPARE_AHEAD;
+    this->schedule_timer->start(std::max(time_to_prepare, (qint64)0));
+}
+
+void MainWindow::ScheduleBoundarySlot()
+{
+    // Station is being changed, which will restart the timer once complete.
+    // Whilst rewound or scanning, the schedule is not followed.
+    if (this->flipping || this->time_shifted || this->scanning || ! this->IsPlaying())
+        return;
+
+    if (! this->next_item_prepared)
+    {
+        // Load next item into the inactive player ahead of time,
+        // then wait for the end of the current item to flip.
+        this->flipping = true;
+        this->DisableMediaButtons();
+
+        this->next_item = this->GetScheduleItemAt(this->current_item.end);
+        std::cout << "Preparing schedule item: " << this->next_item.type << " at " << this->next_item.start << std::endl;
+        this->StartPrepare(PREPARE_STAGE_SCHEDULE,
+                           this->PrepareScheduleItem(this->GetNextPlayer(), this->stations[this->currentStation], this->next_item));
+        return;
+    }
+
+    bool was_playing = this->IsPlaying();
+    this->GetCurrentPlayer()->FlipFrom(was_playing);
+    this->currentPlayerItx = this->currentPlayerItx ? 0 : 1;
     this->GetCurrentPlayer()->FlipTo(was_playing);
+    this->current_item = this->next_item;
 
-    this->SetDisplay(this->GetMediaName());
+    if (this->current_item.type == SCHEDULE_ITEM_MUSIC)
+        this->SetDisplay(this->GetMediaName());
+
+    this->StartScheduleTimer();
+}
+
+void MainWindow::FinishSchedulePrepare(bool prepared)
+{
+    this->flipping = false;
     this->EnableMediaButtons();
+
+    if (! prepared)
+    {
+        // Skip the item, leaving the current one playing until the item after it
+        std::cout << "Unable to prepare schedule item: " << this->next_item.type << " at " << this->next_item.start << std::endl;
+        this->current_item = this->next_item;
+        this->StartScheduleTimer();
+        return;
+    }
+
+    this->next_item_prepared = true;
+    this->schedule_timer->start(std::max(this->current_item.end - this->GetTimelinePosition(), (qint64)0));
+}
+
+void MainWindow::ScanSlot(bool checked)
+{
+    if (checked)
+        this->StartScan();
+    else
+        this->StopScan();
+}
+
+int MainWindow::GetScanPreviewDuration()
+{
+    return this->settings->value(SETTINGS_KEY_SCAN_PREVIEW_DURATION, DEFAULT_SCAN_PREVIEW_DURATION).toInt();
+}
+
+void MainWindow::StartScan()
+{
+    if (this->scanning)
+        return;
+
+    // Nothing to scan through with a single station
+    if (this->stationFileCount < 2 || this->flipping)
+    {
+        this->scan_action->setChecked(false);
+        return;
+    }
+
+    std::cout << "Starting scan" << std::endl;
+    if (! this->IsPlaying())
+        this->Play();
+    this->scanning = true;
+    this->scan_flip_pending = false;
+    this->scan_step = 0;
+    this->scan_preloaded_step = 1;
+    this->scan_action->setChecked(true);
+    this->schedule_timer->stop();
+
+    // Preview current station, whilst the next is prepared
+    this->SetDisplay("Scan: " + this->stations[this->currentStation]->GetName());
+    this->scan_timer->start(this->GetScanPreviewDuration());
+    this->PrepareScanStation((this->currentStation + 1) % this->stationFileCount);
+    this->PreloadScanStations();
+}
+
+void MainWindow::StopScan()
+{
+    if (! this->scanning)
+        return;
+
+    std::cout << "Stopping scan on station: " << this->currentStation << std::endl;
+    this->scanning = false;
+    this->scan_flip_pending = false;
+    this->scan_timer->stop();
+    this->scan_action->setChecked(false);
+    this->scan_pool.clear();
+
+    // The station being prepared is no longer needed. If it is still
+    // being loaded, it is released once loading has finished, and
+    // controls are disabled until then.
+    if (this->scan_preparing)
+        this->DisableMediaButtons();
+    else
+        this->GetNextPlayer()->FlipFrom(false);
+
+    // Stay on the station being previewed
+    this->SaveCurrentStation();
+    this->UpdateRecentStations(this->stations[this->currentStation]);
+    if (this->current_item.type == SCHEDULE_ITEM_MUSIC && ! this->stations[this->currentStation]->IsStream() &&
+        ! this->stations[this->currentStation]->IsPacked())
+        this->SetDisplay(this->GetMediaName());
+    else
+        this->SetDisplay(this->stations[this->currentStation]->GetName());
+    this->StartScheduleTimer();
+}
+
+void MainWindow::PrepareScanStation(int station_index)
+{
+    // Prepare the item that will be on air once the current
+    // preview has finished, so that it can be flipped to straight away.
+    this->flipping = true;
+    this->scan_preparing = true;
+    this->scan_station = station_index;
+    qint64 preview_remaining = std::max(this->scan_timer->remainingTime(), 0);
+    this->scan_item = this->stations[station_index]->GetSchedule()->GetItemAt(this->GetTimelinePosition() + preview_remaining);
+    this->StartPrepare(PREPARE_STAGE_SCAN,
+                       this->PrepareScheduleItem(this->GetNextPlayer(), this->stations[station_index], this->scan_item, true));
+}
+
+void MainWindow::PreloadScanStations()
+{
+    // Station in the inactive player is previewed next, so the ones
+    // after it are read ahead from disk, in the order they will be
+    // previewed, at the position each will be on air.
+    int ahead = std::min(SCAN_PRELOAD_AHEAD, this->stationFileCount - 2);
+    qint64 preview_duration = this->GetScanPreviewDuration();
+    qint64 preview_remaining = std::max(this->scan_timer->remainingTime(), 0);
+    for (int step = std::max(this->scan_preloaded_step + 1, this->scan_step + 2); step <= this->scan_step + 1 + ahead; step ++)
+    {
+        Station* station = this->stations[(this->currentStation + step - this->scan_step) % this->stationFileCount];
+        this->scan_preloaded_step = step;
+        if (station->IsStream() || station->IsPacked())
+            continue;
+
+        qint64 timeline_position = this->GetTimelinePosition() + preview_remaining + (step - this->scan_step - 1) * preview_duration;
+        ScheduleItem item = station->GetSchedule()->GetItemAt(timeline_position);
+        if (item.type != SCHEDULE_ITEM_MUSIC)
+            QtConcurrent::run(&this->scan_pool, Station::Preload, item.file_path, 0.0);
+        else if (station->GetDuration() > 0)
+            QtConcurrent::run(&this->scan_pool, Station::Preload, station->GetFilePath(),
+                              (double)(timeline_position % station->GetDuration()) / station->GetDuration());
+        else
+            QtConcurrent::run(&this->scan_pool, Station::Preload, station->GetFilePath(), 0.0);
+    }
+}
+
+void MainWindow::FinishScanPrepare(bool prepared)
+{
+    this->scan_preparing = false;
+    this->flipping = false;
+
+    if (! this->scanning)
+    {
+        // Scan was stopped whilst the station was being prepared
+        this->GetNextPlayer()->FlipFrom(false);
+        this->EnableMediaButtons();
+        this->StartScheduleTimer();
+        return;
+    }
+
+    if (! prepared)
+    {
+        // Stay on the station being previewed
+        std::cout << "Unable to prepare scan station: " << this->scan_station << std::endl;
+        this->StopScan();
+        return;
+    }
+
+    // Preview ended whilst preparing, so move on straight away.
+    // This is triggered through the timer, rather than flipping
+    // here, so that slow stations do not build up a call chain.
+    if (this->scan_flip_pending)
+        this->scan_timer->start(0);
+}
+
+void MainWindow::ScanTimerSlot()
+{
+    if (! this->scanning)
+        return;
+
+    if (this->scan_preparing)
+    {
+        this->scan_flip_pending = true;
+        return;
+    }
+
+    this->FlipToScanStation();
+}
+
+void MainWindow::FlipToScanStation()
+{
+    // Unlike selecting a station, there is no re-tuning pause,
+    // as the station has already been prepared.
+    this->scan_flip_pending = false;
+    this->GetCurrentPlayer()->FlipFrom(true);
+    this->currentPlayerItx = this->currentPlayerItx ? 0 : 1;
+    this->GetCurrentPlayer()->FlipTo(true);
+    this->currentStation = this->scan_station;
+    this->current_item = this->scan_item;
+    this->time_shifted = false;
+    this->SetDisplay("Scan: " + this->stations[this->currentStation]->GetName());
+    this->scan_step ++;
+
+    this->scan_timer->start(this->GetScanPreviewDuration());
+    this->PrepareScanStation((this->currentStation + 1) % this->stationFileCount);
+    this->PreloadScanStations();
 }
 
 QString MainWindow::GetMediaName()
 {
-    QString name = this->GetCurrentPlayer()->GetMediaPlayer()->metaData(QMediaMetaData::Title).toString();
+    QString name = this->GetCurrentPlayer()->GetMediaTitle();
     if (name.isEmpty()) {
-        name = this->GetCurrentPlayer()->GetMediaPlayer()->currentMedia().canonicalUrl().fileName();
+        name = this->GetCurrentPlayer()->GetMediaFileName();
 
         // Check if name contains a dot and attempt to remove
         if (name.indexOf('.') != -1) {
@@ -519,14 +1281,15 @@ QDial* MainWindow::GetVolumeDial()
 
 void MainWindow::VolumeDialChangeSlot()
 {
+    this->StopScan();
     int new_volume = this->GetVolumeDial()->value();
 
     // Save new volume value
     this->settings->setValue(SETTINGS_KEY_VOLUME, QVariant(new_volume));
 
     // Set volume of both players
-    this->GetCurrentPlayer()->GetMediaPlayer()->setVolume(new_volume);
-    this->GetNextPlayer()->GetMediaPlayer()->setVolume(new_volume);
+    this->GetCurrentPlayer()->SetVolume(new_volume);
+    this->GetNextPlayer()->SetVolume(new_volume);
 }
 
 QPushButton* MainWindow::GetMuteButton()
@@ -567,29 +1330,78 @@ QWidget* MainWindow::GetBackgroundWidget()
 
 void MainWindow::PopulateFileList()
 {
-    // Clear old files
+    // Clear old stations, which the players have already released
+    qDeleteAll(this->stations);
+    this->stations.clear();
     this->stationFileCount = 0;
-    for (int itx = 0; itx < MAX_STATIONS; itx ++)
-        this->stationFiles[itx] = "";
+    this->guide->SetStations(QList<Station*>());
+    qDeleteAll(this->packs);
+    this->packs.clear();
+
+    QElapsedTimer scan_timer;
+    scan_timer.start();
 
     // Setup directory iterator
-    QDirIterator it(this->scan_directory, QStringList() << "*.mp3", QDir::Files, QDirIterator::Subdirectories);
+    QDirIterator it(this->scan_directory, QStringList() << "*.mp3" << "*." STREAM_STATION_EXTENSION << "*." PACK_EXTENSION,
+                    QDir::Files, QDirIterator::Subdirectories);
     QDir dir = QDir::currentPath();
     while (it.hasNext())
     {
-        this->stationFiles[stationFileCount] = dir.cleanPath(dir.absoluteFilePath(it.next()));
-        this->stationFileCount ++;
-        // Check if reached array limit for stations
-        if (this->stationFileCount == MAX_STATIONS)
+        QString file_path = dir.cleanPath(dir.absoluteFilePath(it.next()));
+        this->files_scanned_metric->Increment();
+
+        // Skip jingles/ads/talk belonging to a station
+        if (Station::IsInterstitialFile(file_path))
+            continue;
+
+        // Packs hold any number of stations
+        QList<Station*> new_stations;
+        if (QFileInfo(file_path).suffix().toLower() == PACK_EXTENSION)
+        {
+            Pack* pack = new Pack(file_path);
+            if (! pack->IsValid())
+            {
+                std::cout << "Warning: Invalid station pack: " << file_path.toStdString() << std::endl;
+                delete pack;
+                continue;
+            }
+            this->packs.append(pack);
+            for (int pack_index = 0; pack_index < pack->GetStationCount(); pack_index ++)
+                new_stations << new Station(pack, pack_index);
+        }
+        else
         {
-            this->DisplayError("Reached maximum number of stations.");
-            return;
+            Station* station = new Station(file_path);
+            // Skip playlists that do not contain a stream
+            if (QFileInfo(file_path).suffix().toLower() == STREAM_STATION_EXTENSION && ! station->IsStream())
+            {
+                delete station;
+                continue;
+            }
+            new_stations << station;
         }
+
+        this->stations.append(new_stations);
     }
+    this->stationFileCount = this->stations.count();
+
+    this->scan_duration_metric->Record(scan_timer.elapsed());
+    this->stations_metric->Set(this->stationFileCount);
+
+    this->guide->SetStations(this->stations);
+    this->broadcast_server->SetStations(this->stations);
+    this->waveform_library->SetStations(this->stations);
 }
 
 MainWindow::~MainWindow()
 {
+    // Players hold the streams of stations, so are removed first
+    delete this->players[0];
+    delete this->players[1];
+    delete this->broadcast_server;
+    qDeleteAll(this->stations);
+    qDeleteAll(this->packs);
+    delete this->settings;
     delete ui;
 }
 
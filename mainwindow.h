@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include <QMainWindow>
+#include <QApplication>
 #include <QDirIterator>
 #include <QDebug>
 #include <QMediaPlayer>
@@ -18,13 +19,36 @@
 #include <QMenuBar>
 #include <QSettings>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QActionGroup>
+#include <QStyle>
+#include <QStyleFactory>
+#include <QInputDialog>
+#include <QEvent>
+#include <QShowEvent>
+#include <QHideEvent>
+#include <QThreadPool>
 
 #include "player.h"
+#include "playercontroller.h"
+#include "station.h"
+#include "pack.h"
+#include "schedule.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "theme.h"
+#include "zone.h"
+#include "guide.h"
+#include "guidedialog.h"
+#include "broadcast.h"
+#include "waveform.h"
+#include "waveformdialog.h"
 
-#define MAX_STATIONS 20
 #define INITIAL_VOLUME 40
 #define STATION_CHANGE_DRAMATIC_PAUSE_DURATION 300
 #define MEDIA_LOAD_WAIT_PERIOD 100
+// Time (ms) before the end of a scheduled item to start loading the next item
+#define SCHEDULE_PREPARE_AHEAD 3000
 #define MUTE_BUTTON_TEXT_MUTE "Mute"
 #define MUTE_BUTTON_TEXT_UNMUTE "Unmute"
 #define SETTINGS_KEY_VOLUME "player/volume"
@@ -33,9 +57,38 @@
 #define SETTINGS_KEY_START_EPOC "player/start_epoc"
 #define SETTINGS_KEY_CURRENT_STATION_INDEX "player/station_index"
 #define SETTINGS_KEY_THEME "player/theme"
+#define SETTINGS_KEY_TIME_SHIFT_DURATION "player/time_shift_duration"
+#define SETTINGS_KEY_SCAN_PREVIEW_DURATION "player/scan_preview_duration"
+#define SETTINGS_KEY_WORKER_THREADS "player/worker_threads"
+#define SETTINGS_KEY_METRICS_PORT "metrics/port"
+#define SETTINGS_KEY_METRICS_FILE "metrics/file"
+#define SETTINGS_KEY_METRICS_FILE_INTERVAL "metrics/file_interval"
+#define SETTINGS_KEY_BROADCAST_PORT "broadcast/port"
+#define SETTINGS_KEY_BROADCAST_ADDRESS "broadcast/address"
 #define ORGANISATION "MatthewJohn"
 #define APP_NAME "GTA Radio Player"
 #define DEFAULT_ALWAYS_ON_TOP 0
+// Amount (ms) rewound each time rewind is selected
+#define TIME_SHIFT_REWIND_STEP 30000
+// Number of most recent stations that are recorded for time shift
+#define TIME_SHIFT_RECENT_STATIONS 3
+// Interval (ms) at which file stations are recorded
+#define TIME_SHIFT_RECORD_INTERVAL 1000
+// Time (ms) that each station is played for whilst scanning
+#define DEFAULT_SCAN_PREVIEW_DURATION 5000
+// Number of stations, after the one being prepared, that are preloaded whilst scanning
+#define SCAN_PRELOAD_AHEAD 4
+#define SCAN_PRELOAD_THREADS 2
+// Run each player in its own thread, rather than the GUI thread
+#define DEFAULT_WORKER_THREADS 1
+// Interval (ms) of the timer used to measure GUI frame latency whilst re-tuning
+#define FRAME_PROBE_INTERVAL 16
+// Metrics are disabled unless a port or file is configured
+#define DEFAULT_METRICS_PORT 0
+#define DEFAULT_METRICS_FILE_INTERVAL 60000
+#define DEFAULT_BROADCAST_PORT 0
+// Only this machine can tune in, unless another address is configured
+#define DEFAULT_BROADCAST_ADDRESS "127.0.0.1"
 
 #define THEME_VICE "VICE"
 #define THEME_SA "SA"
@@ -63,6 +116,17 @@ public:
     QLabel* GetPositionLabel();
     qint64 GetStartupTime();
     void DisplayError(QString err);
+    int GetStationCount();
+    Guide* GetGuide();
+    Station* GetCurrentStation();
+    MetricsHistogram* GetFrameLatencyMetric();
+    // Starts re-tuning, which finishes once RetuneFinished is emitted.
+    // Returns false if the station cannot be changed at the moment.
+    bool SelectStation(int station_index);
+
+signals:
+    // Duration (ms) is of preparing the station, excluding the re-tuning pause
+    void RetuneFinished(bool tuned, qint64 prepare_duration);
 
 public slots:
     // Slots for controls
@@ -75,9 +139,33 @@ public slots:
     void OpenChangeDirectory();
     void ResetGlobalTimer();
     void ToggleAlwaysOnTop(bool new_value);
-    void ViceThemeSelectSlot();
-    void SaThemeSelectSlot();
-    void PlainThemeSelectSlot();
+    void ThemeSelectSlot(QAction* action);
+    void AddZoneSlot();
+    void RewindSlot();
+    void ReturnToLiveSlot();
+    void RecordTimeShiftSlot();
+    void RemoveZoneSlot(QAction* action);
+    void ScanSlot(bool checked);
+    void ShowGuideSlot();
+    void ShowWaveformSlot();
+    // Slot for switching between items of the station schedule
+    void ScheduleBoundarySlot();
+    // Slot for moving to the next station whilst scanning
+    void ScanTimerSlot();
+    // Slot for measuring how late the GUI thread handles a frame
+    void FrameProbeSlot();
+    // Slot for continuing once a player has prepared a station
+    void PlayerUpdateSlot();
+    // Slot for flipping to the new station after the re-tuning pause
+    void RetunePauseSlot();
+
+protected:
+    // Times repaints of the window
+    bool event(QEvent *event) override;
+    // Window visibility events, used to switch power mode
+    void changeEvent(QEvent *event) override;
+    void showEvent(QShowEvent *event) override;
+    void hideEvent(QHideEvent *event) override;
 
 private:
     Ui::MainWindow *ui;
@@ -95,22 +183,88 @@ private:
     QAction *always_on_top_action;
     QAction *reset_global_timer;
     QMenu* theme_menu;
-    QAction* vice_theme_action;
-    QAction* sa_theme_action;
-    QAction* plain_theme_action;
+    QActionGroup* theme_action_group;
+    QMenu* time_shift_menu;
+    QAction* rewind_action;
+    QAction* live_action;
+    QMenu* zone_menu;
+    QMenu* remove_zone_menu;
+    QAction* add_zone_action;
+    QAction* scan_action;
+    QAction* guide_action;
+    QAction* waveform_action;
+
+    // Time shift, for recent stations
+    bool time_shifted;
+    QTimer* time_shift_timer;
+    QList<Station*> recent_stations;
+    void UpdateRecentStations(Station* station);
+
+    // Scan, previewing each station in turn.
+    // The next station is prepared in the inactive player whilst
+    // the current station is previewed, and the stations after it
+    // are preloaded from disk in the scan pool.
+    bool scanning;
+    bool scan_preparing;
+    bool scan_flip_pending;
+    int scan_station;
+    ScheduleItem scan_item;
+    QTimer* scan_timer;
+    // Previews since the scan started, and the last one preloaded
+    int scan_step;
+    int scan_preloaded_step;
+    QThreadPool scan_pool;
+    void PreloadScanStations();
+    void StartScan();
+    void StopScan();
+    void PrepareScanStation(int station_index);
+    void FinishScanPrepare(bool prepared);
+    void FlipToScanStation();
+    int GetScanPreviewDuration();
+
+    // What is on air on every station
+    Guide* guide;
+    GuideDialog* guide_dialog;
+
+    // Waveforms of the stations
+    WaveformLibrary* waveform_library;
+    WaveformDialog* waveform_dialog;
+
+    // Streams of every station, for other devices
+    BroadcastServer* broadcast_server;
+
+    // Additional outputs, playing stations independently
+    ZoneManager* zone_manager;
+    void UpdateZoneMenu();
 
     // Settings
     QSettings *settings;
 
-    // player object
-    Player *players[2];
+    // Metrics
+    MetricsServer* metrics_server;
+    MetricsHistogram* retune_duration_metric;
+    MetricsHistogram* scan_duration_metric;
+    MetricsCounter* files_scanned_metric;
+    MetricsGauge* stations_metric;
+    MetricsHistogram* paint_duration_metric;
+    MetricsHistogram* frame_latency_metric;
+    QTimer* frame_probe_timer;
+    QElapsedTimer frame_probe_clock;
+    void SetupMetrics();
+
+    // player objects, each running in its own thread
+    // if worker threads are enabled.
+    bool worker_threads;
+    PlayerController *players[2];
     int currentPlayerItx;
-    Player* GetCurrentPlayer();
-    Player* GetNextPlayer();
+    PlayerController* GetCurrentPlayer();
+    PlayerController* GetNextPlayer();
 
     // List of stations
-    QString stationFiles[MAX_STATIONS];
+    QList<Station*> stations;
     int stationFileCount;
+    // Station packs found in the directory, which outlive their stations
+    QList<Pack*> packs;
     // Directory to scan for MP3s
     QString scan_directory;
 
@@ -118,6 +272,13 @@ private:
     void PopulateFileList();
     void DisablePlayer();
     void UpdateDirectory(QString new_directory, int station_index);
+    // Old stations are released by both players before they are
+    // deleted, which continues from FinishDirectoryUpdate.
+    int directory_station_index;
+    int release_command;
+    void ReleaseStations();
+    void FinishDirectoryUpdate();
+    void SetStationActionsEnabled(bool enabled);
 
     qint64 startupTime;
     void SetStartupTime(bool force_reset, qint64 new_time);
@@ -131,7 +292,41 @@ private:
     void SetVolume(qint64 new_volume);
     bool IsPlayAvailable();
     bool IsPlaying();
-    void SelectStation(int station_index);
+
+    // Schedule of interstitials for current station
+    QTimer* schedule_timer;
+    ScheduleItem current_item;
+    ScheduleItem next_item;
+    bool next_item_prepared;
+    bool flipping;
+    ScheduleItem GetScheduleItemAt(qint64 timeline_position);
+    qint64 GetTimelinePosition();
+    int PrepareScheduleItem(PlayerController* player, Station* station, ScheduleItem item, bool known_duration = false);
+    void FinishSchedulePrepare(bool prepared);
+
+    // Station being prepared in the next player, which is continued
+    // from once the player reports the command as complete.
+    enum PrepareStage
+    {
+        PREPARE_STAGE_NONE,
+        PREPARE_STAGE_SELECT,
+        PREPARE_STAGE_SCHEDULE,
+        PREPARE_STAGE_SCAN,
+        PREPARE_STAGE_REWIND,
+        PREPARE_STAGE_RELEASE
+    };
+    PrepareStage prepare_stage;
+    int prepare_command;
+    void StartPrepare(PrepareStage stage, int command);
+
+    // Re-tuning to a selected station
+    qint64 retune_start;
+    qint64 retune_prepare_duration;
+    ScheduleItem retune_item;
+    QTimer* retune_pause_timer;
+    void FinishSelectPrepare(bool prepared);
+    void FinishRewindPrepare(bool prepared);
+    void StartScheduleTimer();
     QString GetMediaName();
 
     int LoadCurrentStation();
@@ -140,9 +335,17 @@ private:
     void DisableMediaButtons();
     void EnableMediaButtons();
 
+    // Low power mode, whilst window is hidden or minimised
+    bool low_power;
+    void UpdatePowerMode();
+
     void DisableMediaInterupts();
     void EnableMediaInterupts();
 
+    // Themes
+    ThemeLibrary theme_library;
+    QStyle* themed_style;
+    void LoadThemes();
     void SetTheme(QString theme_name);
     void UpdateUiTheme(QString theme_name);
 
@@ -0,0 +1,225 @@
+#include "metrics.h"
+
+#include <QMutexLocker>
+#include <QMap>
+#include <QtAlgorithms>
+
+MetricsCounter::MetricsCounter()
+{
+    this->value = 0;
+}
+
+void MetricsCounter::Increment(quint64 amount)
+{
+    this->value.fetch_add(amount, std::memory_order_relaxed);
+}
+
+quint64 MetricsCounter::Get()
+{
+    return this->value.load(std::memory_order_relaxed);
+}
+
+MetricsGauge::MetricsGauge()
+{
+    this->value = 0;
+}
+
+void MetricsGauge::Set(qint64 new_value)
+{
+    this->value.store(new_value, std::memory_order_relaxed);
+}
+
+qint64 MetricsGauge::Get()
+{
+    return this->value.load(std::memory_order_relaxed);
+}
+
+MetricsHistogram::MetricsHistogram()
+{
+    for (int itx = 0; itx < METRICS_HISTOGRAM_BUCKETS; itx ++)
+        this->buckets[itx] = 0;
+    this->count = 0;
+    this->sum = 0;
+}
+
+int MetricsHistogram::GetBucketIndex(quint64 recorded_value)
+{
+    // Small values each have their own bucket
+    if (recorded_value < METRICS_HISTOGRAM_SUB_BUCKETS)
+        return static_cast<int>(recorded_value);
+
+    // Otherwise, bucket by magnitude, then by the bits following the highest set bit
+    int magnitude = 63 - qCountLeadingZeroBits(recorded_value);
+    int shift = magnitude - METRICS_HISTOGRAM_SUB_BUCKET_BITS;
+    int sub_bucket = static_cast<int>((recorded_value >> shift) & (METRICS_HISTOGRAM_SUB_BUCKETS - 1));
+    return (shift + 1) * METRICS_HISTOGRAM_SUB_BUCKETS + sub_bucket;
+}
+
+quint64 MetricsHistogram::GetBucketUpperBound(int index)
+{
+    if (index < METRICS_HISTOGRAM_SUB_BUCKETS)
+        return index;
+
+    int shift = (index / METRICS_HISTOGRAM_SUB_BUCKETS) - 1;
+    quint64 lower = static_cast<quint64>(METRICS_HISTOGRAM_SUB_BUCKETS + (index % METRICS_HISTOGRAM_SUB_BUCKETS)) << shift;
+    return lower + (static_cast<quint64>(1) << shift) - 1;
+}
+
+void MetricsHistogram::Record(qint64 recorded_value)
+{
+    if (recorded_value < 0)
+        recorded_value = 0;
+
+    this->buckets[MetricsHistogram::GetBucketIndex(recorded_value)].fetch_add(1, std::memory_order_relaxed);
+    this->count.fetch_add(1, std::memory_order_relaxed);
+    this->sum.fetch_add(recorded_value, std::memory_order_relaxed);
+}
+
+quint64 MetricsHistogram::GetCount()
+{
+    return this->count.load(std::memory_order_relaxed);
+}
+
+quint64 MetricsHistogram::GetSum()
+{
+    return this->sum.load(std::memory_order_relaxed);
+}
+
+quint64 MetricsHistogram::GetCountAtOrBelow(quint64 limit)
+{
+    quint64 total = 0;
+    for (int itx = 0; itx < METRICS_HISTOGRAM_BUCKETS && MetricsHistogram::GetBucketUpperBound(itx) <= limit; itx ++)
+        total += this->buckets[itx].load(std::memory_order_relaxed);
+    return total;
+}
+
+quint64 MetricsHistogram::GetPercentile(double percentile)
+{
+    // Returns upper bound of the bucket containing the percentile
+    quint64 total = this->GetCount();
+    if (total == 0)
+        return 0;
+
+    quint64 target = static_cast<quint64>(total * percentile / 100.0);
+    quint64 seen = 0;
+    for (int itx = 0; itx < METRICS_HISTOGRAM_BUCKETS; itx ++)
+    {
+        seen += this->buckets[itx].load(std::memory_order_relaxed);
+        if (seen > target || seen == total)
+            return MetricsHistogram::GetBucketUpperBound(itx);
+    }
+    return MetricsHistogram::GetBucketUpperBound(METRICS_HISTOGRAM_BUCKETS - 1);
+}
+
+Metrics::Metrics()
+{
+}
+
+Metrics* Metrics::Instance()
+{
+    static Metrics instance;
+    return &instance;
+}
+
+void* Metrics::Register(QString name, QString help, QString labels, MetricType type)
+{
+    QMutexLocker locker(&this->mutex);
+
+    // Return existing metric, if already registered
+    for (int itx = 0; itx < this->entries.count(); itx ++)
+        if (this->entries[itx].name == name && this->entries[itx].labels == labels)
+            return this->entries[itx].metric;
+
+    Entry entry;
+    entry.name = name;
+    entry.help = help;
+    entry.labels = labels;
+    entry.type = type;
+    if (type == METRIC_COUNTER)
+        entry.metric = new MetricsCounter;
+    else if (type == METRIC_GAUGE)
+        entry.metric = new MetricsGauge;
+    else
+        entry.metric = new MetricsHistogram;
+    this->entries.append(entry);
+    return entry.metric;
+}
+
+MetricsCounter* Metrics::GetCounter(QString name, QString help, QString labels)
+{
+    return static_cast<MetricsCounter*>(this->Register(name, help, labels, METRIC_COUNTER));
+}
+
+MetricsGauge* Metrics::GetGauge(QString name, QString help, QString labels)
+{
+    return static_cast<MetricsGauge*>(this->Register(name, help, labels, METRIC_GAUGE));
+}
+
+MetricsHistogram* Metrics::GetHistogram(QString name, QString help, QString labels)
+{
+    return static_cast<MetricsHistogram*>(this->Register(name, help, labels, METRIC_HISTOGRAM));
+}
+
+QString Metrics::FormatLabels(QString labels, QString extra_label)
+{
+    if (labels.isEmpty() && extra_label.isEmpty())
+        return "";
+    if (labels.isEmpty())
+        return "{" + extra_label + "}";
+    if (extra_label.isEmpty())
+        return "{" + labels + "}";
+    return "{" + labels + "," + extra_label + "}";
+}
+
+QString Metrics::FormatPrometheus()
+{
+    QMutexLocker locker(&this->mutex);
+
+    // Group metrics by name, as Prometheus requires each family to be contiguous
+    QMap<QString, QList<Entry> > families;
+    for (int itx = 0; itx < this->entries.count(); itx ++)
+        families[this->entries[itx].name].append(this->entries[itx]);
+
+    QString output;
+    for (QMap<QString, QList<Entry> >::iterator family = families.begin(); family != families.end(); ++ family)
+    {
+        const QList<Entry>& entries = family.value();
+        const char* type_name = entries[0].type == METRIC_COUNTER ? "counter" : (entries[0].type == METRIC_GAUGE ? "gauge" : "histogram");
+        output += "# HELP " + family.key() + " " + entries[0].help + "\n";
+        output += "# TYPE " + family.key() + " " + type_name + "\n";
+
+        for (int itx = 0; itx < entries.count(); itx ++)
+        {
+            const Entry& entry = entries[itx];
+            if (entry.type == METRIC_COUNTER)
+            {
+                output += entry.name + Metrics::FormatLabels(entry.labels, "") + " " +
+                          QString::number(static_cast<MetricsCounter*>(entry.metric)->Get()) + "\n";
+            }
+            else if (entry.type == METRIC_GAUGE)
+            {
+                output += entry.name + Metrics::FormatLabels(entry.labels, "") + " " +
+                          QString::number(static_cast<MetricsGauge*>(entry.metric)->Get()) + "\n";
+            }
+            else
+            {
+                // Export fixed buckets at each power of two, so the set
+                // of buckets does not change between scrapes.
+                MetricsHistogram* histogram = static_cast<MetricsHistogram*>(entry.metric);
+                for (int magnitude = 0; magnitude <= METRICS_HISTOGRAM_EXPORT_MAGNITUDE; magnitude ++)
+                {
+                    quint64 limit = (static_cast<quint64>(1) << magnitude) - 1;
+                    output += entry.name + "_bucket" + Metrics::FormatLabels(entry.labels, "le=\"" + QString::number(limit) + "\"") + " " +
+                              QString::number(histogram->GetCountAtOrBelow(limit)) + "\n";
+                }
+                output += entry.name + "_bucket" + Metrics::FormatLabels(entry.labels, "le=\"+Inf\"") + " " +
+                          QString::number(histogram->GetCount()) + "\n";
+                output += entry.name + "_sum" + Metrics::FormatLabels(entry.labels, "") + " " +
+                          QString::number(histogram->GetSum()) + "\n";
+                output += entry.name + "_count" + Metrics::FormatLabels(entry.labels, "") + " " +
+                          QString::number(histogram->GetCount()) + "\n";
+            }
+        }
+    }
+    return output;
+}
@@ -0,0 +1,104 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+
+// Histogram buckets are log-linear (as HDR histograms), with each power
+// of two split into 2^METRICS_HISTOGRAM_SUB_BUCKET_BITS linear buckets.
+#define METRICS_HISTOGRAM_SUB_BUCKET_BITS 3
+#define METRICS_HISTOGRAM_SUB_BUCKETS (1 << METRICS_HISTOGRAM_SUB_BUCKET_BITS)
+#define METRICS_HISTOGRAM_BUCKETS (64 * METRICS_HISTOGRAM_SUB_BUCKETS)
+// Highest power of two exported as a Prometheus bucket
+#define METRICS_HISTOGRAM_EXPORT_MAGNITUDE 24
+
+// Monotonic counter
+class MetricsCounter
+{
+
+public:
+    MetricsCounter();
+    void Increment(quint64 amount = 1);
+    quint64 Get();
+
+private:
+    std::atomic<quint64> value;
+};
+
+// Value that can go up and down
+class MetricsGauge
+{
+
+public:
+    MetricsGauge();
+    void Set(qint64 new_value);
+    qint64 Get();
+
+private:
+    std::atomic<qint64> value;
+};
+
+// Histogram of non-negative integer values
+class MetricsHistogram
+{
+
+public:
+    MetricsHistogram();
+    void Record(qint64 recorded_value);
+    quint64 GetCount();
+    quint64 GetSum();
+    quint64 GetCountAtOrBelow(quint64 limit);
+    quint64 GetPercentile(double percentile);
+
+private:
+    std::atomic<quint64> buckets[METRICS_HISTOGRAM_BUCKETS];
+    std::atomic<quint64> count;
+    std::atomic<quint64> sum;
+
+    static int GetBucketIndex(quint64 recorded_value);
+    static quint64 GetBucketUpperBound(int index);
+};
+
+// Process wide registry of metrics.
+// Registration takes a lock, so callers should keep hold of the returned
+// metric, whereas updating a metric is lock free.
+class Metrics
+{
+
+public:
+    static Metrics* Instance();
+
+    MetricsCounter* GetCounter(QString name, QString help, QString labels = "");
+    MetricsGauge* GetGauge(QString name, QString help, QString labels = "");
+    MetricsHistogram* GetHistogram(QString name, QString help, QString labels = "");
+
+    QString FormatPrometheus();
+
+private:
+    enum MetricType
+    {
+        METRIC_COUNTER,
+        METRIC_GAUGE,
+        METRIC_HISTOGRAM
+    };
+    struct Entry
+    {
+        QString name;
+        QString help;
+        QString labels;
+        MetricType type;
+        void* metric;
+    };
+
+    Metrics();
+    QMutex mutex;
+    QList<Entry> entries;
+
+    void* Register(QString name, QString help, QString labels, MetricType type);
+    static QString FormatLabels(QString labels, QString extra_label);
+};
+
+#endif // METRICS_H
@@ -0,0 +1,84 @@
+#include "metricsserver.h"
+
+#include <iostream>
+
+#include <QHostAddress>
+#include <QSaveFile>
+
+#include "metrics.h"
+
+MetricsServer::MetricsServer(QObject* parent) : QObject(parent)
+{
+    this->server = new QTcpServer(this);
+    QObject::connect(this->server, SIGNAL(newConnection()), this, SLOT(OnNewConnection()));
+
+    this->dump_timer = new QTimer(this);
+    QObject::connect(this->dump_timer, SIGNAL(timeout()), this, SLOT(DumpToFile()));
+}
+
+bool MetricsServer::Listen(quint16 port)
+{
+    // Only listen locally, metrics are not intended to be public
+    if (! this->server->listen(QHostAddress::LocalHost, port))
+    {
+        std::cout << "Unable to start metrics server on port " << port << ": " << this->server->errorString().toStdString() << std::endl;
+        return false;
+    }
+    std::cout << "Metrics available on http://127.0.0.1:" << port << "/metrics" << std::endl;
+    return true;
+}
+
+void MetricsServer::StartFileDump(QString file_path, int interval)
+{
+    this->dump_file_path = file_path;
+    this->dump_timer->start(interval);
+    this->DumpToFile();
+}
+
+void MetricsServer::DumpToFile()
+{
+    // Write to temporary file and rename, so readers never see a partial file
+    QSaveFile file(this->dump_file_path);
+    if (! file.open(QIODevice::WriteOnly))
+    {
+        std::cout << "Unable to write metrics to " << this->dump_file_path.toStdString() << std::endl;
+        return;
+    }
+    file.write(Metrics::Instance()->FormatPrometheus().toUtf8());
+    file.commit();
+}
+
+void MetricsServer::OnNewConnection()
+{
+    while (this->server->hasPendingConnections())
+    {
+        QTcpSocket* socket = this->server->nextPendingConnection();
+        QObject::connect(socket, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+        QObject::connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void MetricsServer::OnReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(this->sender());
+    if (socket == nullptr)
+        return;
+
+    // Wait for end of request headers. Every path is answered with the metrics.
+    QByteArray request = socket->peek(METRICS_MAX_REQUEST_SIZE);
+    if (! request.contains("\r\n\r\n"))
+    {
+        if (request.size() >= METRICS_MAX_REQUEST_SIZE)
+            socket->abort();
+        return;
+    }
+    socket->readAll();
+
+    QByteArray body = Metrics::Instance()->FormatPrometheus().toUtf8();
+    QByteArray response = "HTTP/1.0 200 OK\r\n"
+                          "Content-Type: text/plain; version=0.0.4\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n";
+    socket->write(response + body);
+    socket->disconnectFromHost();
+}
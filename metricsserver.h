@@ -0,0 +1,37 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QString>
+
+// Maximum size of an HTTP request accepted by the metrics endpoint
+#define METRICS_MAX_REQUEST_SIZE 8192
+
+// Exposes the metrics registry in Prometheus text format, either
+// over HTTP on the loopback interface, or by periodically
+// writing it to a file (e.g. for the node exporter textfile collector).
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    MetricsServer(QObject* parent = nullptr);
+
+    bool Listen(quint16 port);
+    void StartFileDump(QString file_path, int interval);
+
+private slots:
+    void OnNewConnection();
+    void OnReadyRead();
+    void DumpToFile();
+
+private:
+    QTcpServer* server;
+    QTimer* dump_timer;
+    QString dump_file_path;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,328 @@
+#include "mp3info.h"
+
+#include <cstring>
+
+#include <QTextCodec>
+
+static const int MPEG1_BITRATES[3][16] = {
+    {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, -1},
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, -1},
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, -1}
+};
+static const int MPEG2_BITRATES[3][16] = {
+    {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, -1},
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, -1},
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, -1}
+};
+static const int MPEG1_SAMPLE_RATES[3] = {44100, 48000, 32000};
+
+static quint32 ReadBigEndian(const unsigned char* data)
+{
+    return (quint32(data[0]) << 24) | (quint32(data[1]) << 16) | (quint32(data[2]) << 8) | quint32(data[3]);
+}
+
+static quint32 ReadSyncSafe(const unsigned char* data)
+{
+    return (quint32(data[0] & 0x7f) << 21) | (quint32(data[1] & 0x7f) << 14) | (quint32(data[2] & 0x7f) << 7) | quint32(data[3] & 0x7f);
+}
+
+Mp3Info::Mp3Info(QString file_path)
+{
+    this->file_path = file_path;
+    this->valid = false;
+    this->duration = 0;
+    this->audio_start = 0;
+    this->audio_end = 0;
+    this->sample_rate = 0;
+    this->encoder_delay = 0;
+    this->encoder_padding = 0;
+    this->Parse();
+}
+
+bool Mp3Info::ParseFrameHeader(const unsigned char* data, Mp3FrameHeader& header)
+{
+    // Check for frame sync
+    if (data[0] != 0xff || (data[1] & 0xe0) != 0xe0)
+        return false;
+
+    int version_bits = (data[1] >> 3) & 0x03;
+    int layer_bits = (data[1] >> 1) & 0x03;
+    int bitrate_index = data[2] >> 4;
+    int sample_rate_index = (data[2] >> 2) & 0x03;
+    int padding = (data[2] >> 1) & 0x01;
+
+    // Reserved/free-format values are not supported
+    if (version_bits == 1 || layer_bits == 0 || bitrate_index == 0 || bitrate_index == 15 || sample_rate_index == 3)
+        return false;
+
+    header.version = version_bits == 3 ? 1 : (version_bits == 2 ? 2 : 25);
+    header.layer = 4 - layer_bits;
+    header.channels = (data[3] >> 6) == 3 ? 1 : 2;
+
+    if (header.version == 1)
+        header.bitrate = MPEG1_BITRATES[header.layer - 1][bitrate_index] * 1000;
+    else
+        header.bitrate = MPEG2_BITRATES[header.layer - 1][bitrate_index] * 1000;
+
+    header.sample_rate = MPEG1_SAMPLE_RATES[sample_rate_index];
+    if (header.version == 2)
+        header.sample_rate /= 2;
+    else if (header.version == 25)
+        header.sample_rate /= 4;
+
+    if (header.layer == 1)
+    {
+        header.samples_per_frame = 384;
+        header.frame_size = (12 * header.bitrate / header.sample_rate + padding) * 4;
+    }
+    else if (header.layer == 2 || header.version == 1)
+    {
+        header.samples_per_frame = 1152;
+        header.frame_size = 144 * header.bitrate / header.sample_rate + padding;
+    }
+    else
+    {
+        header.samples_per_frame = 576;
+        header.frame_size = 72 * header.bitrate / header.sample_rate + padding;
+    }
+
+    return header.frame_size > MP3_FRAME_HEADER_SIZE;
+}
+
+void Mp3Info::Parse()
+{
+    QFile file(this->file_path);
+    if (! file.open(QIODevice::ReadOnly))
+        return;
+
+    qint64 file_size = file.size();
+    this->audio_end = file_size;
+
+    // Check for ID3v1 tag at end of file, which is used as a fallback for the title
+    if (file_size > 128 && file.seek(file_size - 128))
+    {
+        QByteArray id3v1 = file.read(128);
+        if (id3v1.startsWith("TAG"))
+        {
+            this->audio_end -= 128;
+            // Title is padded with NULs, which trimmed() leaves in place
+            QByteArray title = id3v1.mid(3, 30);
+            if (title.indexOf('\0') != -1)
+                title.truncate(title.indexOf('\0'));
+            this->title = QString::fromLatin1(title).trimmed();
+        }
+    }
+
+    // Skip over any ID3v2 tag at start of file
+    file.seek(0);
+    QByteArray id3_header = file.read(10);
+    if (id3_header.size() == 10 && id3_header.startsWith("ID3"))
+    {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(id3_header.constData());
+        qint64 tag_size = ReadSyncSafe(data + 6);
+        this->ParseId3v2(file.read(tag_size), data[3]);
+        this->audio_start = 10 + tag_size + ((data[5] & 0x10) ? 10 : 0);
+    }
+
+    // Find first valid frame
+    file.seek(this->audio_start);
+    QByteArray head = file.read(MP3_MAX_SYNC_SEARCH);
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(head.constData());
+    Mp3FrameHeader header;
+    int offset = 0;
+    for (; offset + MP3_FRAME_HEADER_SIZE <= head.size(); offset ++)
+    {
+        if (! Mp3Info::ParseFrameHeader(data + offset, header))
+            continue;
+
+        // Confirm sync by checking the following frame, where available
+        Mp3FrameHeader next_header;
+        int next_offset = offset + header.frame_size;
+        if (next_offset + MP3_FRAME_HEADER_SIZE > head.size() || Mp3Info::ParseFrameHeader(data + next_offset, next_header))
+            break;
+    }
+    if (offset + MP3_FRAME_HEADER_SIZE > head.size())
+        return;
+
+    this->audio_start += offset;
+    this->sample_rate = header.sample_rate;
+
+    if (! this->ParseVbrHeader(data + offset, head.size() - offset, header))
+    {
+        // No VBR header, so assume constant bitrate
+        this->duration = (this->audio_end - this->audio_start) * 8 * 1000 / header.bitrate;
+    }
+
+    this->valid = this->duration > 0;
+}
+
+static int GetXingOffset(const Mp3FrameHeader& header)
+{
+    // Xing/Info header sits directly after the side information
+    int side_info_size;
+    if (header.version == 1)
+        side_info_size = header.channels == 1 ? 17 : 32;
+    else
+        side_info_size = header.channels == 1 ? 9 : 17;
+    return MP3_FRAME_HEADER_SIZE + side_info_size;
+}
+
+bool Mp3Info::IsVbrHeaderFrame(const unsigned char* frame, qint64 length, const Mp3FrameHeader& header)
+{
+    int xing_offset = GetXingOffset(header);
+    if (xing_offset + 4 <= length &&
+        (memcmp(frame + xing_offset, "Xing", 4) == 0 || memcmp(frame + xing_offset, "Info", 4) == 0))
+        return true;
+    return MP3_VBRI_OFFSET + 4 <= length && memcmp(frame + MP3_VBRI_OFFSET, "VBRI", 4) == 0;
+}
+
+bool Mp3Info::ParseVbrHeader(const unsigned char* frame, int length, const Mp3FrameHeader& header)
+{
+    int xing_offset = GetXingOffset(header);
+    qint64 frame_count = -1;
+
+    if (xing_offset + 8 <= length &&
+        (memcmp(frame + xing_offset, "Xing", 4) == 0 || memcmp(frame + xing_offset, "Info", 4) == 0))
+    {
+        quint32 flags = ReadBigEndian(frame + xing_offset + 4);
+        int field_offset = xing_offset + 8;
+
+        if ((flags & 0x01) && field_offset + 4 <= length)
+            frame_count = ReadBigEndian(frame + field_offset);
+        field_offset += (flags & 0x01) ? 4 : 0;
+        field_offset += (flags & 0x02) ? 4 : 0;
+        field_offset += (flags & 0x04) ? 100 : 0;
+        field_offset += (flags & 0x08) ? 4 : 0;
+
+        // LAME extension holds encoder delay and padding
+        if (field_offset + 24 <= length && memcmp(frame + field_offset, "LAME", 4) == 0)
+        {
+            const unsigned char* delay = frame + field_offset + 21;
+            this->encoder_delay = (delay[0] << 4) | (delay[1] >> 4);
+            this->encoder_padding = ((delay[1] & 0x0f) << 8) | delay[2];
+        }
+    }
+    else if (MP3_VBRI_OFFSET + 18 <= length && memcmp(frame + MP3_VBRI_OFFSET, "VBRI", 4) == 0)
+    {
+        frame_count = ReadBigEndian(frame + MP3_VBRI_OFFSET + 14);
+    }
+
+    if (frame_count <= 0)
+        return false;
+
+    qint64 samples = frame_count * header.samples_per_frame - this->encoder_delay - this->encoder_padding;
+    this->duration = samples * 1000 / header.sample_rate;
+    return true;
+}
+
+void Mp3Info::ParseId3v2(const QByteArray& tag, int major_version)
+{
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(tag.constData());
+    int id_size = major_version == 2 ? 3 : 4;
+    int header_size = major_version == 2 ? 6 : 10;
+    const char* title_id = major_version == 2 ? "TT2" : "TIT2";
+
+    int offset = 0;
+    while (offset + header_size <= tag.size())
+    {
+        // Padding reached
+        if (data[offset] == 0)
+            break;
+
+        qint64 frame_size;
+        if (major_version == 2)
+            frame_size = (data[offset + 3] << 16) | (data[offset + 4] << 8) | data[offset + 5];
+        else if (major_version == 4)
+            frame_size = ReadSyncSafe(data + offset + 4);
+        else
+            frame_size = ReadBigEndian(data + offset + 4);
+
+        if (frame_size <= 0 || offset + header_size + frame_size > tag.size())
+            break;
+
+        if (memcmp(data + offset, title_id, id_size) == 0)
+        {
+            QString title = Mp3Info::DecodeId3Text(tag.mid(offset + header_size, frame_size));
+            if (! title.isEmpty())
+                this->title = title;
+            return;
+        }
+
+        offset += header_size + frame_size;
+    }
+}
+
+QString Mp3Info::DecodeId3Text(const QByteArray& data)
+{
+    if (data.isEmpty())
+        return QString();
+
+    QByteArray text = data.mid(1);
+    QString decoded;
+    switch (data[0])
+    {
+        case 1:
+            decoded = QTextCodec::codecForName("UTF-16")->toUnicode(text);
+            break;
+        case 2:
+            decoded = QTextCodec::codecForName("UTF-16BE")->toUnicode(text);
+            break;
+        case 3:
+            decoded = QString::fromUtf8(text);
+            break;
+        default:
+            decoded = QString::fromLatin1(text);
+            break;
+    }
+
+    // Remove null terminators
+    int null_index = decoded.indexOf(QChar(0));
+    if (null_index != -1)
+        decoded.truncate(null_index);
+    return decoded.trimmed();
+}
+
+bool Mp3Info::IsValid()
+{
+    return this->valid;
+}
+
+QString Mp3Info::GetFilePath()
+{
+    return this->file_path;
+}
+
+QString Mp3Info::GetTitle()
+{
+    return this->title;
+}
+
+qint64 Mp3Info::GetDuration()
+{
+    return this->duration;
+}
+
+qint64 Mp3Info::GetAudioStart()
+{
+    return this->audio_start;
+}
+
+qint64 Mp3Info::GetAudioEnd()
+{
+    return this->audio_end;
+}
+
+int Mp3Info::GetSampleRate()
+{
+    return this->sample_rate;
+}
+
+int Mp3Info::GetEncoderDelay()
+{
+    return this->encoder_delay;
+}
+
+int Mp3Info::GetEncoderPadding()
+{
+    return this->encoder_padding;
+}
@@ -0,0 +1,65 @@
+#ifndef MP3INFO_H
+#define MP3INFO_H
+
+#include <QString>
+#include <QFile>
+
+// Size of an MPEG audio frame header, in bytes
+#define MP3_FRAME_HEADER_SIZE 4
+// Maximum number of bytes scanned for the first frame after any ID3 tag
+#define MP3_MAX_SYNC_SEARCH 65536
+// Offset of a VBRI header within the first frame
+#define MP3_VBRI_OFFSET (MP3_FRAME_HEADER_SIZE + 32)
+
+// Details of a single MPEG audio frame header
+struct Mp3FrameHeader
+{
+    int version;            // 1 = MPEG 1, 2 = MPEG 2, 25 = MPEG 2.5
+    int layer;
+    int bitrate;            // bits per second
+    int sample_rate;
+    int channels;
+    int samples_per_frame;
+    int frame_size;         // bytes, including header
+};
+
+// Reads duration and tag information from an MP3 file by parsing
+// headers only, without decoding any audio.
+class Mp3Info
+{
+
+public:
+    Mp3Info(QString file_path);
+
+    bool IsValid();
+    QString GetFilePath();
+    QString GetTitle();
+    qint64 GetDuration();
+    qint64 GetAudioStart();
+    qint64 GetAudioEnd();
+    int GetSampleRate();
+    int GetEncoderDelay();
+    int GetEncoderPadding();
+
+    static bool ParseFrameHeader(const unsigned char* data, Mp3FrameHeader& header);
+    // Whether a frame holds a Xing/Info/VBRI header, rather than audio
+    static bool IsVbrHeaderFrame(const unsigned char* frame, qint64 length, const Mp3FrameHeader& header);
+
+private:
+    QString file_path;
+    bool valid;
+    QString title;
+    qint64 duration;
+    qint64 audio_start;
+    qint64 audio_end;
+    int sample_rate;
+    int encoder_delay;
+    int encoder_padding;
+
+    void Parse();
+    void ParseId3v2(const QByteArray& tag, int major_version);
+    bool ParseVbrHeader(const unsigned char* frame, int length, const Mp3FrameHeader& header);
+    static QString DecodeId3Text(const QByteArray& data);
+};
+
+#endif // MP3INFO_H
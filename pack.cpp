@@ -0,0 +1,487 @@
+#include "pack.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QAtomicInt>
+#include <QtConcurrent>
+
+#include "mp3info.h"
+#include "station.h"
+#include "waveform.h"
+
+Pack::Pack(QString file_path) : file(file_path)
+{
+    this->data = nullptr;
+    this->header = nullptr;
+    if (! this->file.open(QIODevice::ReadOnly) || this->file.size() < (qint64)sizeof(PackHeader))
+        return;
+
+    // Audio is read straight from the mapped file by the players
+    this->data = this->file.map(0, this->file.size());
+    if (this->data == nullptr)
+        return;
+
+    qint64 size = this->file.size();
+    const PackHeader* header = reinterpret_cast<const PackHeader*>(this->data);
+    if (header->magic != PACK_MAGIC || header->version != PACK_VERSION || header->station_count == 0 ||
+        header->station_table_offset < (qint64)sizeof(PackHeader) ||
+        header->station_table_offset % alignof(PackStationEntry) != 0 ||
+        header->station_table_offset + header->station_count * (qint64)sizeof(PackStationEntry) > size)
+        return;
+
+    const PackStationEntry* entries = reinterpret_cast<const PackStationEntry*>(this->data + header->station_table_offset);
+    for (quint32 station = 0; station < header->station_count; station ++)
+        if (! Pack::IsValidStation(entries[station], size, this->data))
+            return;
+    this->header = header;
+
+    // Hashing a large pack takes a while, so players wait for it on first use
+    this->verification = QtConcurrent::run(this, &Pack::Verify);
+}
+
+bool Pack::IsValidStation(const PackStationEntry& entry, qint64 size, const uchar* data)
+{
+    if (entry.duration <= 0 || entry.duration > PACK_MAX_DURATION ||
+        entry.sample_rate < PACK_MIN_SAMPLE_RATE || entry.sample_rate > PACK_MAX_SAMPLE_RATE ||
+        entry.samples_per_frame <= 0 || entry.samples_per_frame > PACK_MAX_SAMPLES_PER_FRAME ||
+        entry.frames_per_chunk <= 0 || entry.chunk_count <= 0)
+        return false;
+
+    // Offsets and sizes are compared against the space left after them,
+    // so that none of the sums can overflow.
+    if (entry.data_offset < 0 || entry.data_offset > size ||
+        entry.data_size < MP3_FRAME_HEADER_SIZE || entry.data_size > size - entry.data_offset ||
+        entry.chunk_table_offset < 0 || entry.chunk_table_offset > size ||
+        entry.chunk_table_offset % (qint64)sizeof(qint64) != 0 ||
+        (qint64)entry.chunk_count + 1 > (size - entry.chunk_table_offset) / (qint64)sizeof(qint64))
+        return false;
+
+    // Each chunk holds at least one frame
+    if ((qint64)entry.chunk_count > entry.data_size / MP3_FRAME_HEADER_SIZE)
+        return false;
+
+    // Duration is rounded down from the number of frames, so the chunk
+    // count must fit the range of frame counts giving that duration.
+    qint64 frame_samples = (qint64)entry.samples_per_frame * 1000;
+    qint64 min_frames = (entry.duration * entry.sample_rate + frame_samples - 1) / frame_samples;
+    qint64 max_frames = ((entry.duration + 1) * entry.sample_rate - 1) / frame_samples;
+    if (entry.chunk_count < (min_frames + entry.frames_per_chunk - 1) / entry.frames_per_chunk ||
+        entry.chunk_count > (max_frames + entry.frames_per_chunk - 1) / entry.frames_per_chunk)
+        return false;
+
+    // Chunks cover the whole of the audio, in order
+    const qint64* chunks = reinterpret_cast<const qint64*>(data + entry.chunk_table_offset);
+    if (chunks[0] != 0 || chunks[entry.chunk_count] != entry.data_size)
+        return false;
+    for (qint32 chunk = 0; chunk < entry.chunk_count; chunk ++)
+        if (chunks[chunk + 1] <= chunks[chunk])
+            return false;
+    return true;
+}
+
+bool Pack::IsValid()
+{
+    return this->header != nullptr;
+}
+
+QString Pack::GetFilePath()
+{
+    return this->file.fileName();
+}
+
+int Pack::GetStationCount()
+{
+    return this->header->station_count;
+}
+
+const PackStationEntry* Pack::GetStation(int station_index)
+{
+    return reinterpret_cast<const PackStationEntry*>(this->data + this->header->station_table_offset) + station_index;
+}
+
+QString Pack::GetStationName(int station_index)
+{
+    const char* name = this->GetStation(station_index)->name;
+    return QString::fromUtf8(name, strnlen(name, PACK_NAME_SIZE));
+}
+
+QString Pack::GetStationFileName(int station_index)
+{
+    const char* file_name = this->GetStation(station_index)->file_name;
+    return QString::fromUtf8(file_name, strnlen(file_name, PACK_NAME_SIZE));
+}
+
+const qint64* Pack::GetChunkTable(int station_index)
+{
+    return reinterpret_cast<const qint64*>(this->data + this->GetStation(station_index)->chunk_table_offset);
+}
+
+const uchar* Pack::GetStationData(int station_index)
+{
+    return this->data + this->GetStation(station_index)->data_offset;
+}
+
+bool Pack::Verify()
+{
+    // Hashed in blocks, so that closing the pack does not wait for the whole file
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    qint64 size = this->file.size();
+    for (qint64 offset = sizeof(PackHeader); offset < size; offset += PACK_VERIFY_BLOCK_SIZE)
+    {
+        if (this->verify_cancelled.loadAcquire())
+            return false;
+        hash.addData(reinterpret_cast<const char*>(this->data + offset), std::min(size - offset, (qint64)PACK_VERIFY_BLOCK_SIZE));
+    }
+
+    bool verified = hash.result() == QByteArray(reinterpret_cast<const char*>(this->header->hash), PACK_HASH_SIZE);
+    if (! verified)
+        std::cout << "Warning: Station pack failed verification: " << this->file.fileName().toStdString() << std::endl;
+    return verified;
+}
+
+QFuture<bool> Pack::GetVerification()
+{
+    return this->verification;
+}
+
+bool Pack::Write(QString directory, QString pack_path)
+{
+    // Same station files as would be loaded from the directory
+    QStringList files;
+    QDirIterator it(directory, QStringList() << "*.mp3", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+    {
+        QString file_path = it.next();
+        if (! Station::IsInterstitialFile(file_path))
+            files << file_path;
+    }
+    files.sort();
+    if (files.isEmpty())
+    {
+        std::cout << "Pack: no station files found in " << directory.toStdString() << std::endl;
+        return false;
+    }
+
+    // Stations are scanned and measured in parallel, one per core
+    QList<StationScan> results = QtConcurrent::blockingMapped(files, Pack::ScanStation);
+    QList<StationScan> scans;
+    for (int itx = 0; itx < results.count(); itx ++)
+        if (results[itx].valid)
+            scans.append(results[itx]);
+    if (scans.isEmpty())
+        return false;
+
+    PackHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PACK_MAGIC;
+    header.version = PACK_VERSION;
+    header.station_count = scans.count();
+    header.station_table_offset = sizeof(header);
+    qint64 offset = header.station_table_offset + scans.count() * sizeof(PackStationEntry);
+    for (int itx = 0; itx < scans.count(); itx ++)
+    {
+        scans[itx].entry.chunk_table_offset = offset;
+        offset += scans[itx].chunk_offsets.count() * sizeof(qint64);
+    }
+    for (int itx = 0; itx < scans.count(); itx ++)
+    {
+        scans[itx].entry.data_offset = offset;
+        offset += scans[itx].entry.data_size;
+    }
+
+    // Hash is filled in once the contents have been written
+    QSaveFile file(pack_path);
+    if (! file.open(QIODevice::WriteOnly))
+    {
+        std::cout << "Pack: unable to write " << pack_path.toStdString() << ": " << file.errorString().toStdString() << std::endl;
+        return false;
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (int itx = 0; itx < scans.count(); itx ++)
+    {
+        const char* entry = reinterpret_cast<const char*>(&scans[itx].entry);
+        file.write(entry, sizeof(PackStationEntry));
+        hash.addData(entry, sizeof(PackStationEntry));
+    }
+    for (int itx = 0; itx < scans.count(); itx ++)
+    {
+        // Chunk offsets are stored relative to the start of the station audio
+        QVector<qint64> chunk_table = scans[itx].chunk_offsets;
+        for (int chunk = chunk_table.count() - 1; chunk >= 0; chunk --)
+            chunk_table[chunk] -= chunk_table[0];
+        const char* table = reinterpret_cast<const char*>(chunk_table.constData());
+        file.write(table, chunk_table.count() * sizeof(qint64));
+        hash.addData(table, chunk_table.count() * sizeof(qint64));
+    }
+    for (int itx = 0; itx < scans.count(); itx ++)
+    {
+        QFile source(scans[itx].file_path);
+        uchar* audio = source.open(QIODevice::ReadOnly) ? source.map(scans[itx].chunk_offsets.first(), scans[itx].entry.data_size) : nullptr;
+        if (audio == nullptr)
+        {
+            std::cout << "Pack: unable to read " << scans[itx].file_path.toStdString() << std::endl;
+            file.cancelWriting();
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(audio), scans[itx].entry.data_size);
+        hash.addData(reinterpret_cast<const char*>(audio), scans[itx].entry.data_size);
+        source.unmap(audio);
+    }
+
+    QByteArray result = hash.result();
+    memcpy(header.hash, result.constData(), PACK_HASH_SIZE);
+    file.seek(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (! file.commit())
+        return false;
+
+    for (int itx = 0; itx < scans.count(); itx ++)
+        std::cout << "Packed " << scans[itx].file_path.toStdString() << ": " << scans[itx].entry.chunk_count << " chunks, "
+                  << scans[itx].entry.loudness << " dBFS" << std::endl;
+    return true;
+}
+
+Pack::StationScan Pack::ScanStation(QString file_path)
+{
+    StationScan scan;
+    scan.file_path = file_path;
+    scan.valid = false;
+    memset(&scan.entry, 0, sizeof(scan.entry));
+
+    Mp3Info info(file_path);
+    QFile file(file_path);
+    uchar* data = info.IsValid() && file.open(QIODevice::ReadOnly) ? file.map(0, file.size()) : nullptr;
+    if (data == nullptr)
+    {
+        std::cout << "Pack: unable to read " << file_path.toStdString() << std::endl;
+        return scan;
+    }
+
+    qint64 offset = info.GetAudioStart();
+    qint64 end = info.GetAudioEnd();
+    Mp3FrameHeader header;
+    if (! Mp3Info::ParseFrameHeader(data + offset, header))
+        return scan;
+    // Xing/Info/VBRI header frames hold no audio, so are left out of packs
+    if (Mp3Info::IsVbrHeaderFrame(data + offset, end - offset, header))
+        offset += header.frame_size;
+
+    // Chunks start on frame boundaries, every whole number of frames
+    // closest to the chunk duration.
+    PackStationEntry& entry = scan.entry;
+    entry.sample_rate = header.sample_rate;
+    entry.samples_per_frame = header.samples_per_frame;
+    entry.frames_per_chunk = std::max(qRound(PACK_CHUNK_DURATION * header.sample_rate / 1000.0 / header.samples_per_frame), 1);
+
+    qint64 frame_count = 0;
+    Mp3FrameHeader frame;
+    while (offset + MP3_FRAME_HEADER_SIZE <= end && Mp3Info::ParseFrameHeader(data + offset, frame) && offset + frame.frame_size <= end)
+    {
+        // Seeking relies on every frame having the same duration
+        if (frame.sample_rate != entry.sample_rate || frame.samples_per_frame != entry.samples_per_frame)
+            break;
+        if (frame_count % entry.frames_per_chunk == 0)
+            scan.chunk_offsets.append(offset);
+        offset += frame.frame_size;
+        frame_count ++;
+    }
+    scan.chunk_offsets.append(offset);
+    file.unmap(data);
+    if (frame_count == 0)
+        return scan;
+    if (offset < end)
+        std::cout << "Pack: ignoring " << end - offset << " bytes after last frame of " << file_path.toStdString() << std::endl;
+
+    QString name = info.GetTitle();
+    if (name.isEmpty())
+        name = QFileInfo(file_path).completeBaseName();
+    Pack::CopyName(entry.name, name);
+    Pack::CopyName(entry.file_name, QFileInfo(file_path).fileName());
+    entry.duration = frame_count * entry.samples_per_frame * 1000 / entry.sample_rate;
+    entry.chunk_count = scan.chunk_offsets.count() - 1;
+    entry.data_size = offset - scan.chunk_offsets.first();
+    entry.loudness = Pack::MeasureLoudness(file_path);
+    scan.valid = true;
+    return scan;
+}
+
+double Pack::MeasureLoudness(QString file_path)
+{
+    // Waveform buckets already hold the RMS level of each part of the file
+    QAtomicInt cancelled(0);
+    WaveformBuilder builder(file_path, &cancelled);
+    if (! builder.Run())
+        return PACK_SILENCE_LOUDNESS;
+
+    QVector<WaveformBucket> buckets = builder.GetBuckets();
+    double power = 0;
+    for (int itx = 0; itx < buckets.count(); itx ++)
+    {
+        double level = buckets[itx].rms * 128.0 / 32768;
+        power += level * level;
+    }
+    power /= buckets.count();
+    return power > 0 ? std::max(10 * std::log10(power), (double)PACK_SILENCE_LOUDNESS) : PACK_SILENCE_LOUDNESS;
+}
+
+void Pack::CopyName(char* name, QString value)
+{
+    QByteArray utf8 = value.toUtf8().left(PACK_NAME_SIZE - 1);
+    memset(name, 0, PACK_NAME_SIZE);
+    memcpy(name, utf8.constData(), utf8.size());
+}
+
+Pack::~Pack()
+{
+    // Verification reads from the mapped file
+    this->verify_cancelled.storeRelease(1);
+    this->verification.waitForFinished();
+    if (this->data != nullptr)
+        this->file.unmap(this->data);
+}
+
+PackReader::PackReader(Pack* pack, int station_index)
+{
+    this->pack = pack;
+    this->entry = pack->GetStation(station_index);
+    this->chunks = pack->GetChunkTable(station_index);
+    this->audio = pack->GetStationData(station_index);
+    this->frame_duration = this->entry->samples_per_frame * 1000.0 / this->entry->sample_rate;
+    this->startup_time = 0;
+    this->started = false;
+    this->read_offset = 0;
+    this->available_offset = 0;
+    this->available_time = 0;
+
+    // Timer is started by the first SetStartupTime, in the player thread
+    this->pace_timer = new QTimer(this);
+    QObject::connect(this->pace_timer, SIGNAL(timeout()), this, SLOT(OnPace()));
+    this->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+void PackReader::SetStartupTime(qint64 startup_time)
+{
+    this->startup_time = startup_time;
+    if (! this->pace_timer->isActive())
+        this->pace_timer->start(PACK_PACE_INTERVAL);
+
+    // Available audio runs ahead of the live position by up to the
+    // read ahead, unless the timeline has moved since.
+    qint64 live = this->GetTimelinePosition();
+    if (! this->started || this->available_time < live - PACK_RESYNC_TOLERANCE ||
+        this->available_time > live + PACK_READ_AHEAD + PACK_RESYNC_TOLERANCE)
+    {
+        this->Seek(live);
+        this->started = true;
+    }
+}
+
+Pack* PackReader::GetPack()
+{
+    return this->pack;
+}
+
+qint64 PackReader::GetDuration()
+{
+    return this->entry->duration;
+}
+
+qint64 PackReader::GetPosition()
+{
+    qint64 duration = this->entry->duration;
+    return ((this->GetTimelinePosition() % duration) + duration) % duration;
+}
+
+qint64 PackReader::GetTimelinePosition()
+{
+    return QDateTime::currentMSecsSinceEpoch() - this->startup_time;
+}
+
+void PackReader::Seek(qint64 timeline_position)
+{
+    qint64 duration = this->entry->duration;
+    qint64 position = ((timeline_position % duration) + duration) % duration;
+    qint64 loop = (timeline_position - position) / duration;
+
+    // Chunk holding the position is looked up directly, then the
+    // remaining frames within it are skipped.
+    qint64 chunk_samples = (qint64)this->entry->frames_per_chunk * this->entry->samples_per_frame;
+    qint64 chunk = std::min(position * this->entry->sample_rate / 1000 / chunk_samples, (qint64)this->entry->chunk_count - 1);
+    qint64 offset = this->chunks[chunk];
+    double time = chunk * this->entry->frames_per_chunk * this->frame_duration;
+    Mp3FrameHeader header;
+    while (offset < this->chunks[chunk + 1] && offset + MP3_FRAME_HEADER_SIZE <= this->entry->data_size &&
+           time + this->frame_duration <= position && Mp3Info::ParseFrameHeader(this->audio + offset, header))
+    {
+        offset += header.frame_size;
+        time += this->frame_duration;
+    }
+
+    this->read_offset = offset;
+    this->available_offset = this->read_offset;
+    this->available_time = loop * duration + time;
+}
+
+void PackReader::MakeAvailable(double timeline_position)
+{
+    // Whole frames only, wrapping back to the first at the end
+    Mp3FrameHeader header;
+    while (this->available_time < timeline_position &&
+           this->available_offset % this->entry->data_size + MP3_FRAME_HEADER_SIZE <= this->entry->data_size &&
+           Mp3Info::ParseFrameHeader(this->audio + this->available_offset % this->entry->data_size, header))
+    {
+        this->available_offset += header.frame_size;
+        this->available_time += this->frame_duration;
+    }
+}
+
+bool PackReader::isSequential() const
+{
+    return true;
+}
+
+qint64 PackReader::bytesAvailable() const
+{
+    return this->available_offset - this->read_offset + QIODevice::bytesAvailable();
+}
+
+qint64 PackReader::readData(char* data, qint64 max_size)
+{
+    this->MakeAvailable(this->GetTimelinePosition() + PACK_READ_AHEAD);
+
+    qint64 read_size = std::min(max_size, this->available_offset - this->read_offset);
+    qint64 copied = 0;
+    while (copied < read_size)
+    {
+        qint64 offset = this->read_offset % this->entry->data_size;
+        qint64 length = std::min(read_size - copied, this->entry->data_size - offset);
+        memcpy(data + copied, this->audio + offset, length);
+        copied += length;
+        this->read_offset += length;
+    }
+    return read_size;
+}
+
+qint64 PackReader::writeData(const char* data, qint64 max_size)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(max_size);
+    return -1;
+}
+
+void PackReader::OnPace()
+{
+    this->MakeAvailable(this->GetTimelinePosition() + PACK_READ_AHEAD);
+    if (this->available_offset > this->read_offset)
+        emit readyRead();
+}
@@ -0,0 +1,175 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QByteArray>
+#include <QFile>
+#include <QTimer>
+#include <QFuture>
+#include <QAtomicInt>
+
+// Station packs combine the station files of a directory into a single
+// file, which is memory mapped by the player.
+#define PACK_EXTENSION "gtapack"
+#define PACK_MAGIC 0x4b415047
+#define PACK_VERSION 1
+// Target duration (ms) of each chunk. Chunks are a whole number of
+// frames, so the exact duration depends on the sample rate.
+#define PACK_CHUNK_DURATION 1000
+#define PACK_NAME_SIZE 128
+#define PACK_HASH_SIZE 32
+// Amount of audio (ms) made available to the backend ahead of the
+// live position, so it always has data buffered.
+#define PACK_READ_AHEAD 1000
+// Interval (ms) at which more audio is made available
+#define PACK_PACE_INTERVAL 100
+// Difference (ms) from the live position allowed before re-seeking
+#define PACK_RESYNC_TOLERANCE 150
+// Loudness (dBFS) reported for silent stations
+#define PACK_SILENCE_LOUDNESS -96
+// Amount (bytes) hashed at a time whilst verifying, between checks for cancellation
+#define PACK_VERIFY_BLOCK_SIZE (4 * 1024 * 1024)
+// Limits of station entries accepted from a pack, beyond which it is
+// taken to be corrupt. Duration is in ms.
+#define PACK_MIN_SAMPLE_RATE 8000
+#define PACK_MAX_SAMPLE_RATE 48000
+#define PACK_MAX_SAMPLES_PER_FRAME 1152
+#define PACK_MAX_DURATION (24LL * 60 * 60 * 1000)
+
+// Start of a pack, followed by the station table, then the chunk
+// table and audio of each station.
+struct PackHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 station_count;
+    quint32 reserved;
+    qint64 station_table_offset;
+    // SHA-256 of everything following the header
+    quint8 hash[PACK_HASH_SIZE];
+};
+
+// Station held in a pack
+struct PackStationEntry
+{
+    // UTF-8, padded with NULs
+    char name[PACK_NAME_SIZE];
+    // Name of the original station file, which seeds the schedule
+    char file_name[PACK_NAME_SIZE];
+    qint64 duration;
+    qint32 sample_rate;
+    qint32 samples_per_frame;
+    qint32 frames_per_chunk;
+    qint32 chunk_count;
+    // Mean loudness (dBFS)
+    double loudness;
+    // Table of chunk_count + 1 offsets, relative to the audio data,
+    // where the last is the end of the audio.
+    qint64 chunk_table_offset;
+    qint64 data_offset;
+    qint64 data_size;
+};
+
+// Pack of stations, memory mapped for reading.
+// Tables are checked when the pack is opened, and the contents are
+// verified against the hash in the background.
+class Pack
+{
+
+public:
+    Pack(QString file_path);
+    ~Pack();
+
+    bool IsValid();
+    QString GetFilePath();
+    int GetStationCount();
+    const PackStationEntry* GetStation(int station_index);
+    QString GetStationName(int station_index);
+    QString GetStationFileName(int station_index);
+    const qint64* GetChunkTable(int station_index);
+    const uchar* GetStationData(int station_index);
+    // Compares the hash of the contents with the one stored
+    bool Verify();
+    // Result of verifying the pack in the background, started once opened
+    QFuture<bool> GetVerification();
+
+    // Packs the station files of a directory, using all cores
+    static bool Write(QString directory, QString pack_path);
+
+private:
+    struct StationScan
+    {
+        QString file_path;
+        PackStationEntry entry;
+        // Absolute offsets in the station file of each chunk, and the end of the audio
+        QVector<qint64> chunk_offsets;
+        bool valid;
+    };
+
+    QFile file;
+    uchar* data;
+    const PackHeader* header;
+    QFuture<bool> verification;
+    QAtomicInt verify_cancelled;
+
+    static bool IsValidStation(const PackStationEntry& entry, qint64 size, const uchar* data);
+    static StationScan ScanStation(QString file_path);
+    static double MeasureLoudness(QString file_path);
+    static void CopyName(char* name, QString value);
+};
+
+// Sequential device, playing a station of a pack from its position on
+// the global timeline. Seeking looks up the chunk directly, and audio
+// is made available at the rate it is played, so the player stays
+// locked to the timeline.
+class PackReader : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    PackReader(Pack* pack, int station_index);
+    Pack* GetPack();
+
+    // Seeks to the live position if the timeline has moved
+    void SetStartupTime(qint64 startup_time);
+    qint64 GetDuration();
+    // Position in the station of the global timeline
+    qint64 GetPosition();
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char* data, qint64 max_size) override;
+    qint64 writeData(const char* data, qint64 max_size) override;
+
+private slots:
+    void OnPace();
+
+private:
+    Pack* pack;
+    const PackStationEntry* entry;
+    const qint64* chunks;
+    const uchar* audio;
+    double frame_duration;
+    qint64 startup_time;
+    bool started;
+    QTimer* pace_timer;
+
+    // Offsets are counted across loops of the station, so the
+    // offset in the audio is the offset modulo its size.
+    qint64 read_offset;
+    qint64 available_offset;
+    // Timeline position at the end of the available audio
+    double available_time;
+
+    qint64 GetTimelinePosition();
+    void Seek(qint64 timeline_position);
+    void MakeAvailable(double timeline_position);
+};
+
+#endif // PACK_H
@@ -1,35 +1,91 @@
 #include "player.h"
-#include "mainwindow.h"
+
+#include <iostream>
 
 Player::Player()
 {
-    this->player = new QMediaPlayer;
+    // Media objects are created by Setup, in the thread of the player
+    this->player = nullptr;
+    this->playlist = nullptr;
+    this->player_index = 0;
+    this->startup_time = 0;
+    this->snapshot.completed_command = 0;
+    this->snapshot.position_update = 0;
+    this->snapshot.failed_command = 0;
     this->is_active = false;
     this->media_interupts_enabled = false;
-    this->media_buffered = false;
-    this->media_loaded = false;
+    this->load_timer = nullptr;
+    this->verification_watcher = nullptr;
+    this->load_command = 0;
+    this->load_stage = LOAD_STAGE_IDLE;
+    this->load_probe_duration = false;
+    this->load_resume = false;
+    this->load_was_active = false;
+    this->load_volume = 0;
+    this->low_power = false;
+    this->position_notifications_connected = false;
     this->track_duration = 0;
+    this->last_position = 0;
+    this->item_start = -1;
+    this->stream = nullptr;
+    this->time_shift_reader = nullptr;
+    this->pack_reader = nullptr;
+    this->seek_error_pending = false;
+
+    Metrics* metrics = Metrics::Instance();
+    this->load_duration_metric = metrics->GetHistogram("gta_retune_stage_duration_ms", "Duration of each stage of loading a station", "stage=\"load\"");
+    this->buffer_duration_metric = metrics->GetHistogram("gta_retune_stage_duration_ms", "Duration of each stage of loading a station", "stage=\"buffer\"");
+    this->probe_duration_metric = metrics->GetHistogram("gta_retune_stage_duration_ms", "Duration of each stage of loading a station", "stage=\"duration\"");
+    this->seek_error_metric = metrics->GetHistogram("gta_seek_error_ms", "Difference between global timeline and position after seeking");
+    this->backend_errors_metric = metrics->GetCounter("gta_backend_errors_total", "Errors reported by the media backend");
+    this->stalled_metric = metrics->GetCounter("gta_buffer_underruns_total", "Buffer underruns during playback", "source=\"backend\"");
 }
 
-void Player::Setup(MainWindow* main_window, int player_index)
+void Player::Setup(int player_index)
 {
-    this->main_window = main_window;
     this->player_index = player_index;
+    this->player = new QMediaPlayer(this);
+
+    // Loop the station inside the backend, rather than waiting for the
+    // player to stop and then restarting it. This shortens the gap at
+    // the end of the track, but does not remove it, as the backend still
+    // reloads the media. Zones play decoded audio, so loop gaplessly.
+    this->playlist = new QMediaPlaylist(this);
+    this->playlist->setPlaybackMode(QMediaPlaylist::CurrentItemInLoop);
+    this->player->setPlaylist(this->playlist);
 
     QObject::connect(this->GetMediaPlayer(), SIGNAL(stateChanged(QMediaPlayer::State)), this, SLOT(OnStateChanged(QMediaPlayer::State)));
     QObject::connect(this->GetMediaPlayer(), SIGNAL(durationChanged(qint64)), this, SLOT(OnDurationChange(qint64)));
-    QObject::connect(this->GetMediaPlayer(), SIGNAL(positionChanged(qint64)), this, SLOT(OnPositionChanged(qint64)));
     QObject::connect(this->GetMediaPlayer(), SIGNAL(mediaStatusChanged(QMediaPlayer::MediaStatus)), this, SLOT(OnMediaStatusChange(QMediaPlayer::MediaStatus)));
+    QObject::connect(this->GetMediaPlayer(), SIGNAL(error(QMediaPlayer::Error)), this, SLOT(OnError(QMediaPlayer::Error)));
+
+    // Loading fails if the backend never reports the media as buffered
+    this->load_timer = new QTimer(this);
+    this->load_timer->setSingleShot(true);
+    QObject::connect(this->load_timer, SIGNAL(timeout()), this, SLOT(OnLoadTimeout()));
+    this->verification_watcher = new QFutureWatcher<bool>(this);
+    QObject::connect(this->verification_watcher, SIGNAL(finished()), this, SLOT(OnPackVerified()));
     this->PrintDebug("Setup connectors");
+
+    // Position notifications are only connected whilst the player is active
+    this->UpdatePositionNotifications();
 }
 
 void Player::OnMediaStatusChange(QMediaPlayer::MediaStatus status)
 {
     this->PrintDebug("State: " + QString::number(status));
-    if (status == QMediaPlayer::LoadedMedia)
-        this->media_loaded = true;
-    else if (status == QMediaPlayer::BufferedMedia)
-        this->media_buffered = true;
+    if (this->load_stage != LOAD_STAGE_IDLE)
+        this->AdvanceLoad();
+    else if (status == QMediaPlayer::StalledMedia && this->is_active)
+        this->stalled_metric->Increment();
+}
+
+void Player::OnError(QMediaPlayer::Error error)
+{
+    this->PrintDebug("Error " + QString::number(error) + ": " + this->GetMediaPlayer()->errorString());
+    this->backend_errors_metric->Increment();
+    if (this->load_stage != LOAD_STAGE_IDLE)
+        this->FailLoad(this->GetMediaPlayer()->errorString(), true);
 }
 
 QMediaPlayer* Player::GetMediaPlayer()
@@ -37,6 +93,45 @@ QMediaPlayer* Player::GetMediaPlayer()
     return this->player;
 }
 
+PlayerSnapshot Player::TakeSnapshot()
+{
+    QMutexLocker locker(&this->snapshot_mutex);
+    this->snapshot_pending.storeRelease(0);
+    return this->snapshot;
+}
+
+void Player::PublishSnapshot()
+{
+    // Only notify if the last notification has been handled, so
+    // a slow GUI thread reads the latest state once, rather than
+    // working through a queue of stale updates.
+    if (this->snapshot_pending.fetchAndStoreOrdered(1) == 0)
+        emit SnapshotReady();
+}
+
+void Player::CompleteCommand(int command, bool failed)
+{
+    {
+        QMutexLocker locker(&this->snapshot_mutex);
+        this->snapshot.completed_command = command;
+        if (failed)
+            this->snapshot.failed_command = command;
+        this->snapshot.media_title = this->GetMediaPlayer()->metaData(QMediaMetaData::Title).toString();
+        this->snapshot.media_file_name = this->GetMediaPlayer()->currentMedia().canonicalUrl().fileName();
+    }
+    this->PublishSnapshot();
+}
+
+void Player::SetPositionText(QString text)
+{
+    {
+        QMutexLocker locker(&this->snapshot_mutex);
+        this->snapshot.position_text = text;
+        this->snapshot.position_update ++;
+    }
+    this->PublishSnapshot();
+}
+
 void Player::OnPositionChanged(qint64 new_position)
 {
 
@@ -44,7 +139,78 @@ void Player::OnPositionChanged(qint64 new_position)
     if (! this->is_active)
         return;
 
-    qint64 duration = this->GetMediaPlayer()->duration();
+    this->RecordSeekError(new_position);
+    this->CheckLoopDrift(new_position);
+
+    // Label is not visible, so avoid re-rendering it
+    if (this->low_power)
+        return;
+
+    this->UpdatePositionLabel(new_position);
+}
+
+void Player::RecordSeekError(qint64 new_position)
+{
+    // Compare first position reported after a seek with the global timeline
+    if (! this->seek_error_pending)
+        return;
+    this->seek_error_pending = false;
+
+    qint64 expected_position = this->GetTimelinePosition();
+    if (expected_position >= 0)
+        this->seek_error_metric->Record(std::llabs(new_position - expected_position));
+}
+
+void Player::CheckLoopDrift(qint64 new_position)
+{
+    qint64 previous_position = this->last_position;
+    this->last_position = new_position;
+
+    // Only check drift once a looping track has wrapped around to the start
+    if (! this->media_interupts_enabled || this->item_start >= 0 || new_position >= previous_position)
+        return;
+
+    qint64 expected_position = this->GetTimelinePosition();
+    if (expected_position < 0)
+        return;
+
+    // Backend and timeline may wrap either side of each other, so
+    // drift is taken as the shortest distance around the loop.
+    qint64 duration = this->GetDuration();
+    qint64 drift = (((new_position - expected_position) % duration) + duration) % duration;
+    if (drift > duration / 2)
+        drift -= duration;
+    if (std::llabs(drift) > LOOP_DRIFT_TOLERANCE)
+    {
+        this->PrintDebug("Track looped with drift of " + QString::number(drift) + "ms, re-syncing.");
+        this->SeekToTimeline();
+    }
+}
+
+void Player::UpdatePositionLabel(qint64 new_position)
+{
+    // Live streams have no position on the global timeline
+    if (this->stream != nullptr)
+    {
+        this->SetPositionText("Live");
+        return;
+    }
+
+    // Whilst rewound, show how far behind live
+    if (this->time_shift_reader != nullptr)
+    {
+        qint64 delay = this->time_shift_reader->GetDelay(this->GetMediaPlayer()->position()) / 1000;
+        char label_text[32];
+        snprintf(label_text, sizeof(label_text), "-%lld:%02lld", (long long)(delay / 60), (long long)(delay % 60));
+        this->SetPositionText(label_text);
+        return;
+    }
+
+    // Backend position counts from when the pack was opened
+    if (this->pack_reader != nullptr)
+        new_position = this->pack_reader->GetPosition();
+
+    qint64 duration = this->GetDuration();
 
     if (duration >= 1000)
     {
@@ -73,85 +239,302 @@ void Player::OnPositionChanged(qint64 new_position)
             dur_hrs,
             dur_mins % 60,
             duration % 60);
-        this->main_window->GetPositionLabel()->setText(label_text);
+        this->SetPositionText(label_text);
     } else {
-        this->main_window->GetPositionLabel()->setText("0:00:00 / 0:00:00");
+        this->SetPositionText("0:00:00 / 0:00:00");
     }
 }
 
+void Player::SetLowPowerMode(bool low_power)
+{
+    if (this->low_power == low_power)
+        return;
+
+    this->PrintDebug(low_power ? "Entering low power mode." : "Leaving low power mode.");
+    this->low_power = low_power;
+    this->UpdatePositionNotifications();
+
+    // Label has not been updated whilst in low power mode, so bring
+    // it up to date straight away rather than waiting for the next tick.
+    if (! low_power && this->is_active)
+        this->UpdatePositionLabel(this->GetMediaPlayer()->position());
+}
+
+void Player::UpdatePositionNotifications()
+{
+    // Inactive players do not need position updates at all.
+    // The active player only needs them at full rate when the
+    // window is visible, otherwise they are throttled.
+    bool connect_notifications = this->is_active;
+    int notify_interval = (this->is_active && ! this->low_power) ? POSITION_NOTIFY_INTERVAL : LOW_POWER_NOTIFY_INTERVAL;
+
+    if (this->GetMediaPlayer()->notifyInterval() != notify_interval)
+        this->GetMediaPlayer()->setNotifyInterval(notify_interval);
+
+    if (connect_notifications && ! this->position_notifications_connected)
+        QObject::connect(this->GetMediaPlayer(), SIGNAL(positionChanged(qint64)), this, SLOT(OnPositionChanged(qint64)));
+    else if (! connect_notifications && this->position_notifications_connected)
+        QObject::disconnect(this->GetMediaPlayer(), SIGNAL(positionChanged(qint64)), this, SLOT(OnPositionChanged(qint64)));
+
+    this->position_notifications_connected = connect_notifications;
+}
 
 void Player::OnDurationChange(qint64 new_duration) {
     this->PrintDebug("OnDurationChange called: " + QString::number(new_duration));
     this->track_duration = new_duration;
+    if (this->load_stage == LOAD_STAGE_PROBING)
+        this->AdvanceLoad();
 }
 
 void Player::OnStateChanged(QMediaPlayer::State newState) {
     this->PrintDebug("Media State: " + QString::number(newState));
 
-    // If interupts are disabled (when swapping players), if some comes to an end,
-    // start the player again.
-    if (this->media_interupts_enabled && newState == QMediaPlayer::StoppedState) {
+    // Looping is handled by the playlist, but if the backend does stop the
+    // player whilst interupts are enabled (i.e. not when swapping players),
+    // start it again from the position of the global timeline.
+    // Items that do not loop are stopped by the backend at the end
+    // and replaced by the next item of the schedule.
+    if (this->media_interupts_enabled && this->item_start < 0 && newState == QMediaPlayer::StoppedState) {
         this->PrintDebug("Interupts enabled, resarting current player.");
+        this->SeekToTimeline();
         this->GetMediaPlayer()->play();
     }
 }
 
-void Player::PrepareFlipTo(QUrl url)
+void Player::PrepareFlipToFile(QUrl url, qint64 item_start, qint64 known_duration, int command)
 {
     this->PrintDebug("Starting PrepareFlipTo.");
-    this->media_loaded = false;
-    this->media_buffered = false;
-    this->track_duration = 0;
-
-    int old_volume = this->GetMediaPlayer()->volume();
-    bool was_active = this->is_active;
+    this->CancelLoad();
+    this->ReleaseDevice();
+    this->track_duration = known_duration > 0 ? known_duration : 0;
+    this->item_start = item_start;
+    // Duration has already been read from the file, so there is no
+    // need to probe the backend for it.
+    this->BeginLoad(command, known_duration <= 0);
 
     // Update file path of next player
     this->PrintDebug("Loading file: " + url.url());
-    this->GetMediaPlayer()->setMedia(url);
+    if (this->GetMediaPlayer()->playlist() != this->playlist)
+        this->GetMediaPlayer()->setPlaylist(this->playlist);
+    this->playlist->clear();
+    this->playlist->setPlaybackMode(item_start < 0 ? QMediaPlaylist::CurrentItemInLoop : QMediaPlaylist::CurrentItemOnce);
+    this->playlist->addMedia(url);
+    this->playlist->setCurrentIndex(0);
+    this->AdvanceLoad();
+}
+
+void Player::PrepareFlipToStream(StreamBuffer* stream, int command)
+{
+    this->PrintDebug("Starting PrepareFlipTo for stream.");
+    this->CancelLoad();
+    this->ReleaseDevice();
+
+    // Streams are live, so have no duration to wait for.
+    // Start reading from the buffered tail of the stream.
+    this->PrintDebug("Loading stream: " + stream->GetUrl().url());
+    stream->SetActive(true);
+    this->stream = stream;
+    this->track_duration = 0;
+    this->PrepareFlipToDevice(stream, command);
+}
+
+void Player::PrepareFlipToTimeShift(TimeShiftReader* reader, int command)
+{
+    this->PrintDebug("Starting PrepareFlipTo for time shift.");
+    this->CancelLoad();
+    this->ReleaseDevice();
+
+    // Player takes ownership of the reader
+    this->time_shift_reader = reader;
+    this->track_duration = 0;
+    this->PrepareFlipToDevice(reader, command);
+}
+
+void Player::PrepareFlipToPack(PackReader* reader, qint64 startup_time, int command)
+{
+    this->PrintDebug("Starting PrepareFlipTo for pack.");
+    this->CancelLoad();
+    this->ReleaseDevice();
+
+    // Player takes ownership of the reader, which starts
+    // from the live position of the global timeline.
+    this->startup_time = startup_time;
+    reader->SetStartupTime(startup_time);
+    this->pack_reader = reader;
+    this->track_duration = reader->GetDuration();
+    this->item_start = -1;
+
+    // Pack may still be being verified in the background, which is
+    // waited for, without a timeout, before the media is set.
+    this->BeginLoad(command, false);
+    this->load_stage = LOAD_STAGE_VERIFYING;
+    this->load_timer->stop();
+    this->verification_watcher->setFuture(reader->GetPack()->GetVerification());
+}
+
+void Player::OnPackVerified()
+{
+    // Load may have been cancelled whilst waiting
+    if (this->load_stage != LOAD_STAGE_VERIFYING)
+        return;
+
+    if (! this->verification_watcher->result())
+    {
+        this->FailLoad("Station pack is corrupt: " + this->pack_reader->GetPack()->GetFilePath(), true);
+        return;
+    }
+
+    this->load_stage = LOAD_STAGE_LOADING;
+    this->load_stage_timer.start();
+    this->load_timer->start(PLAYER_LOAD_TIMEOUT);
+    this->GetMediaPlayer()->setMedia(QMediaContent(), this->pack_reader);
+    this->AdvanceLoad();
+}
+
+void Player::Rewind(qint64 step, int command)
+{
+    // Only the reader moves, so the backend carries on with what it
+    // has buffered, then continues seamlessly from the earlier audio.
+    if (this->time_shift_reader != nullptr)
+        this->time_shift_reader->Rewind(step);
+    this->CompleteCommand(command, false);
+}
+
+void Player::PrepareFlipToDevice(QIODevice* device, int command)
+{
+    // Devices have no duration to probe for
+    this->item_start = -1;
+    this->BeginLoad(command, false);
+    this->GetMediaPlayer()->setMedia(QMediaContent(), device);
+    this->AdvanceLoad();
+}
+
+void Player::BeginLoad(int command, bool probe_duration)
+{
+    // Stages are moved through as the backend reports the media
+    // status, so the thread is never blocked waiting for it.
+    this->load_command = command;
+    this->load_stage = LOAD_STAGE_LOADING;
+    this->load_probe_duration = probe_duration;
+    this->load_resume = false;
+    this->load_was_active = this->is_active;
+    this->is_active = false;
+    this->load_stage_timer.start();
+    this->load_timer->start(PLAYER_LOAD_TIMEOUT);
+    this->PrintDebug("Waiting for media to load.");
+}
+
+void Player::AdvanceLoad()
+{
+    // Media is not set until verification has finished
+    if (this->load_stage == LOAD_STAGE_VERIFYING)
+        return;
 
     // Check for any errors after loading media
     if (this->GetMediaPlayer()->error())
-        this->main_window->DisplayError(this->GetMediaPlayer()->errorString());
+    {
+        this->FailLoad(this->GetMediaPlayer()->errorString(), true);
+        return;
+    }
 
-    this->PrintDebug("Waiting for media to load.");
-    while (this->media_loaded == false)
-        // Wait for 50ms
-        QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
-    this->PrintDebug("Media loaded.");
+    QMediaPlayer::MediaStatus status = this->GetMediaPlayer()->mediaStatus();
+    if (status == QMediaPlayer::InvalidMedia)
+    {
+        this->FailLoad("Unable to load station media", true);
+        return;
+    }
 
-    // Play track
-    this->is_active = false;
-    this->GetMediaPlayer()->pause();
+    if (this->load_stage == LOAD_STAGE_LOADING &&
+        (status == QMediaPlayer::LoadedMedia || status == QMediaPlayer::BufferingMedia || status == QMediaPlayer::BufferedMedia))
+    {
+        this->load_duration_metric->Record(this->load_stage_timer.restart());
+        this->PrintDebug("Media loaded.");
+
+        // Pausing starts the backend buffering the media
+        this->load_stage = LOAD_STAGE_BUFFERING;
+        this->PrintDebug("Waiting for media to buffer.");
+        this->GetMediaPlayer()->pause();
+        status = this->GetMediaPlayer()->mediaStatus();
+    }
 
-    // Wait for media to buffer
-    this->PrintDebug("Waiting for media to buffer.");
-    while (this->media_buffered == false)
-        // Wait for 50ms
-        QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
-    this->PrintDebug("Media buffered.");
-
-    // Wait for position to be set (and required flag set to false)
-    // @TODO: Do not play audio with minimal volume - this will be audible to the user.
-    // This is required as the duration will not be populated (nor will the durationChanged
-    // slot be called) if: media is paused instead of played, mediaplayer volume is set to 0
-    // or mediaplayer is set to muted.
-    // Therefore, this is the only way to be able to obtain the duration of the track.
-    this->GetMediaPlayer()->setVolume(1);
-    this->GetMediaPlayer()->play();
-    this->PrintDebug("Waiting for duration to be set.");
-    while (this->track_duration == 0)
-        // Wait for 50ms
-        QCoreApplication::processEvents(QEventLoop::AllEvents, 50);
-    this->GetMediaPlayer()->pause();
-    this->PrintDebug("Duration set.");
+    if (this->load_stage == LOAD_STAGE_BUFFERING && status == QMediaPlayer::BufferedMedia)
+    {
+        this->buffer_duration_metric->Record(this->load_stage_timer.restart());
+        this->PrintDebug("Media buffered.");
+        if (! this->load_probe_duration)
+        {
+            this->FinishLoad();
+            return;
+        }
 
-    this->GetMediaPlayer()->setVolume(old_volume);
-    this->is_active = was_active;
+        // @TODO: Do not play audio with minimal volume - this will be audible to the user.
+        // This is required as the duration will not be populated (nor will the durationChanged
+        // slot be called) if: media is paused instead of played, mediaplayer volume is set to 0
+        // or mediaplayer is set to muted.
+        // Therefore, this is the only way to be able to obtain the duration of the track.
+        this->load_stage = LOAD_STAGE_PROBING;
+        this->load_volume = this->GetMediaPlayer()->volume();
+        this->PrintDebug("Waiting for duration to be set.");
+        this->GetMediaPlayer()->setVolume(1);
+        this->GetMediaPlayer()->play();
+    }
 
+    if (this->load_stage == LOAD_STAGE_PROBING && this->track_duration > 0)
+    {
+        this->GetMediaPlayer()->pause();
+        this->GetMediaPlayer()->setVolume(this->load_volume);
+        this->probe_duration_metric->Record(this->load_stage_timer.elapsed());
+        this->PrintDebug("Duration set.");
+        this->FinishLoad();
+    }
+}
+
+void Player::FinishLoad()
+{
+    int command = this->load_command;
+    this->load_command = 0;
+    this->load_stage = LOAD_STAGE_IDLE;
+    this->load_timer->stop();
+    this->is_active = this->load_was_active;
+    if (this->load_resume && this->is_active)
+        this->GetMediaPlayer()->play();
+    this->CompleteCommand(command, false);
     this->PrintDebug("Finished PrepareFlipTo.");
 }
 
+void Player::FailLoad(QString error, bool report)
+{
+    int command = this->load_command;
+    if (this->load_stage == LOAD_STAGE_PROBING)
+        this->GetMediaPlayer()->setVolume(this->load_volume);
+    this->load_command = 0;
+    this->load_stage = LOAD_STAGE_IDLE;
+    this->load_timer->stop();
+    this->is_active = this->load_was_active;
+
+    // Nothing is left loaded, so a failed station is never flipped to
+    this->PrintDebug("Loading failed: " + error);
+    this->ReleaseDevice();
+    this->GetMediaPlayer()->stop();
+    this->playlist->clear();
+    this->CompleteCommand(command, true);
+    if (report)
+        emit Error(error);
+}
+
+void Player::CancelLoad()
+{
+    // Superseded by a later command, which the GUI thread is now waiting for instead
+    if (this->load_stage != LOAD_STAGE_IDLE)
+        this->FailLoad("Cancelled", false);
+}
+
+void Player::OnLoadTimeout()
+{
+    if (this->load_stage != LOAD_STAGE_IDLE)
+        this->FailLoad("Timed out loading station", true);
+}
+
 void Player::PrintDebug(QString debug)
 {
     std::cout << "Player " << this->player_index << ": " << debug.toStdString() << std::endl;
@@ -160,22 +543,52 @@ void Player::PrintDebug(QString debug)
 void Player::FlipFrom(bool was_playing)
 {
     this->PrintDebug("Starting FipFrom.");
+    this->CancelLoad();
 
     this->is_active = false;
     this->media_interupts_enabled = false;
+    this->UpdatePositionNotifications();
 
     if (was_playing)
         this->player->pause();
 
+    this->ReleaseDevice();
+
     this->PrintDebug("Finished FipFrom.");
 }
 
-void Player::FlipTo(bool was_playing)
+void Player::ReleaseDevice()
+{
+    // Release stream, so it only keeps the live tail whilst not
+    // being played and the other player can take it over.
+    if (this->stream != nullptr)
+    {
+        this->GetMediaPlayer()->setMedia(QMediaContent());
+        this->stream->SetActive(false);
+        this->stream = nullptr;
+    }
+    if (this->time_shift_reader != nullptr)
+    {
+        this->GetMediaPlayer()->setMedia(QMediaContent());
+        delete this->time_shift_reader;
+        this->time_shift_reader = nullptr;
+    }
+    if (this->pack_reader != nullptr)
+    {
+        this->GetMediaPlayer()->setMedia(QMediaContent());
+        delete this->pack_reader;
+        this->pack_reader = nullptr;
+    }
+}
+
+void Player::FlipTo(bool was_playing, qint64 startup_time)
 {
     this->PrintDebug("Starting FlipTo.");
-    this->SetPosition();
+    this->startup_time = startup_time;
+    this->SeekToTimeline();
 
     this->is_active = true;
+    this->UpdatePositionNotifications();
     if (was_playing)
         this->Play();
 
@@ -183,19 +596,58 @@ void Player::FlipTo(bool was_playing)
     this->PrintDebug("Finished FlipTo.");
 }
 
-void Player::SetPosition()
+qint64 Player::GetTimelinePosition()
+{
+    // Position based on time since application startup, using modulus of track length
+    // for looping tracks, or offset from start of item for scheduled items.
+    // Returns -1 for tts less than 0, maybe due to time change or race condition,
+    // or if the track duration is not yet known.
+    qint64 tts = (QDateTime::currentMSecsSinceEpoch() - this->startup_time);
+    qint64 dur = this->GetDuration();
+    if (this->stream != nullptr || this->time_shift_reader != nullptr || this->pack_reader != nullptr || tts < 0 || dur <= 0)
+        return -1;
+    if (this->item_start >= 0)
+        return std::min(std::max(tts - this->item_start, (qint64)0), dur);
+    return tts % dur;
+}
+
+qint64 Player::GetDuration()
+{
+    // Duration reported by the backend, or the duration read from
+    // the file if the backend has not yet reported it.
+    qint64 duration = this->GetMediaPlayer()->duration();
+    return duration > 0 ? duration : this->track_duration;
+}
+
+void Player::SetPosition(qint64 startup_time)
+{
+    this->startup_time = startup_time;
+    this->SeekToTimeline();
+}
+
+void Player::SetStartupTime(qint64 startup_time)
 {
-    // Set position based on time since application startup, using modulus of track length.
-    // Ignore tts less than 0, maybe due to time change or race condition
-    qint64 tts = (QDateTime::currentMSecsSinceEpoch() - this->main_window->GetStartupTime());
-    if (tts >= 0)
+    this->startup_time = startup_time;
+    if (this->pack_reader != nullptr)
+        this->pack_reader->SetStartupTime(startup_time);
+}
+
+void Player::SeekToTimeline()
+{
+    // Packs cannot be seeked by the backend, so the reader seeks instead
+    if (this->pack_reader != nullptr)
     {
-        qint64 dur = this->GetMediaPlayer()->duration();
-        this->PrintDebug("Track duration: " + QString::number(this->GetMediaPlayer()->duration()) + ".");
-        if (dur > 0) {
-            this->PrintDebug("Setting track to position: " + QString::number(tts % this->GetMediaPlayer()->duration()));
-            this->GetMediaPlayer()->setPosition(tts % this->GetMediaPlayer()->duration());
-        }
+        this->pack_reader->SetStartupTime(this->startup_time);
+        return;
+    }
+
+    this->PrintDebug("Track duration: " + QString::number(this->GetDuration()) + ".");
+    qint64 position = this->GetTimelinePosition();
+    if (position >= 0) {
+        this->PrintDebug("Setting track to position: " + QString::number(position));
+        this->last_position = position;
+        this->seek_error_pending = true;
+        this->GetMediaPlayer()->setPosition(position);
     }
 }
 
@@ -203,7 +655,7 @@ void Player::Play()
 {
     this->GetMediaPlayer()->play();
     if (this->GetMediaPlayer()->state() != QMediaPlayer::PlayingState)
-            this->main_window->DisplayError("Not playing");
+            emit Error("Not playing");
 }
 
 void Player::Pause()
@@ -211,7 +663,28 @@ void Player::Pause()
     this->GetMediaPlayer()->pause();
 }
 
+void Player::SetVolume(int volume)
+{
+    this->GetMediaPlayer()->setVolume(volume);
+}
+
+void Player::SetMuted(bool muted)
+{
+    this->GetMediaPlayer()->setMuted(muted);
+}
+
+void Player::Sync(int command)
+{
+    this->CancelLoad();
+    this->CompleteCommand(command, false);
+}
+
 Player::~Player()
 {
+    if (this->player == nullptr)
+        return;
+    this->ReleaseDevice();
+    delete this->player;
+    delete this->playlist;
 }
 
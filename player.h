@@ -2,15 +2,55 @@
 #define PLAYER_H
 
 #include <cmath>
+#include <cstdlib>
+#include <algorithm>
 
 #include <QObject>
 #include <QMediaPlayer>
 #include <QMediaMetaData>
+#include <QMediaPlaylist>
 #include <QLabel>
 #include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QFutureWatcher>
 
-class MainWindow;
+#include "streambuffer.h"
+#include "timeshift.h"
+#include "pack.h"
+#include "metrics.h"
 
+// Interval (ms) at which the backend reports position while the
+// player is active and the window is visible.
+#define POSITION_NOTIFY_INTERVAL 1000
+// Interval (ms) used when the window is hidden/minimised or the
+// player is not active, to avoid needless wakeups.
+#define LOW_POWER_NOTIFY_INTERVAL 10000
+// Maximum difference (ms) between playback position and the global
+// timeline allowed when a track loops, before position is re-synced.
+#define LOOP_DRIFT_TOLERANCE 150
+// Time (ms) allowed for a station to load and buffer before giving up
+#define PLAYER_LOAD_TIMEOUT 10000
+
+// State of a player, published for the GUI thread
+struct PlayerSnapshot
+{
+    // Last command that has been completed
+    int completed_command;
+    // Last command that failed, leaving nothing loaded
+    int failed_command;
+    // Incremented whenever the position text is updated
+    int position_update;
+    QString position_text;
+    QString media_title;
+    QString media_file_name;
+};
+
+// Media player, confined to its own thread (see PlayerController).
+// Commands are queued to its slots, and state is published back as
+// snapshots, of which only the latest is read.
 class Player : public QObject
 {
     Q_OBJECT
@@ -19,33 +59,119 @@ public:
     Player();
     ~Player();
 
-    void Setup(MainWindow* main_window, int player_index);
     QMediaPlayer* GetMediaPlayer();
+    // Thread safe
+    PlayerSnapshot TakeSnapshot();
 
-    void PrepareFlipTo(QUrl url);
+public slots:
+    // Commands, run in the thread of the player
+    void Setup(int player_index);
+    void PrepareFlipToFile(QUrl url, qint64 item_start, qint64 known_duration, int command);
+    void PrepareFlipToStream(StreamBuffer* stream, int command);
+    void PrepareFlipToTimeShift(TimeShiftReader* reader, int command);
+    void PrepareFlipToPack(PackReader* reader, qint64 startup_time, int command);
+    void Rewind(qint64 step, int command);
     void FlipFrom(bool was_playing);
-    void FlipTo(bool was_playing);
+    void FlipTo(bool was_playing, qint64 startup_time);
     void Play();
     void Pause();
-    void SetPosition();
+    void SetPosition(qint64 startup_time);
+    // Follows the global timeline moving, e.g. after a pause, without seeking
+    void SetStartupTime(qint64 startup_time);
+    void SetLowPowerMode(bool low_power);
+    void SetVolume(int volume);
+    void SetMuted(bool muted);
+    // Completes once all earlier commands have been run
+    void Sync(int command);
 
-public slots:
     // Slots for media events
     void OnMediaStatusChange(QMediaPlayer::MediaStatus status);
     void OnDurationChange(qint64 new_duration);
     void OnPositionChanged(qint64 new_position);
     void OnStateChanged(QMediaPlayer::State state);
+    void OnError(QMediaPlayer::Error error);
+    void OnLoadTimeout();
+    void OnPackVerified();
+
+signals:
+    void SnapshotReady();
+    void Error(QString error);
 
 private:
-    MainWindow* main_window;
     QMediaPlayer* player;
+    QMediaPlaylist* playlist;
     int player_index;
+    // Start of the global timeline, as last sent by the GUI thread
+    qint64 startup_time;
     bool is_active;
     bool media_interupts_enabled;
-    bool media_loaded;
-    bool media_buffered;
+    bool low_power;
+    bool position_notifications_connected;
     qint64 track_duration;
+    qint64 last_position;
+    // Position of global timeline that the loaded item started at,
+    // or -1 if the item loops on the global timeline.
+    qint64 item_start;
+    // Stream being played, if a stream station is loaded
+    StreamBuffer* stream;
+    // Time shift buffer being played, if rewound
+    TimeShiftReader* time_shift_reader;
+    // Station pack being played, which follows the global timeline itself
+    PackReader* pack_reader;
+    void PrepareFlipToDevice(QIODevice* device, int command);
+    void ReleaseDevice();
+    void SeekToTimeline();
+
+    // Loading of the media for a PrepareFlipTo command, which completes
+    // the command once the backend has buffered it.
+    enum LoadStage
+    {
+        LOAD_STAGE_IDLE,
+        LOAD_STAGE_VERIFYING,
+        LOAD_STAGE_LOADING,
+        LOAD_STAGE_BUFFERING,
+        LOAD_STAGE_PROBING
+    };
+    LoadStage load_stage;
+    int load_command;
+    bool load_probe_duration;
+    // Whether to play once loaded, when re-loading the active media
+    bool load_resume;
+    bool load_was_active;
+    int load_volume;
+    QTimer* load_timer;
+    QFutureWatcher<bool>* verification_watcher;
+    QElapsedTimer load_stage_timer;
+    void BeginLoad(int command, bool probe_duration);
+    void AdvanceLoad();
+    void FinishLoad();
+    void FailLoad(QString error, bool report);
+    void CancelLoad();
+
+    // Snapshot, with a flag set whilst the GUI thread has
+    // been notified but not yet read it.
+    QMutex snapshot_mutex;
+    PlayerSnapshot snapshot;
+    QAtomicInt snapshot_pending;
+    void PublishSnapshot();
+    void CompleteCommand(int command, bool failed);
+    void SetPositionText(QString text);
+
+    // Metrics
+    bool seek_error_pending;
+    MetricsHistogram* load_duration_metric;
+    MetricsHistogram* buffer_duration_metric;
+    MetricsHistogram* probe_duration_metric;
+    MetricsHistogram* seek_error_metric;
+    MetricsCounter* backend_errors_metric;
+    MetricsCounter* stalled_metric;
+    void RecordSeekError(qint64 new_position);
+    qint64 GetTimelinePosition();
+    qint64 GetDuration();
+    void CheckLoopDrift(qint64 new_position);
     void PrintDebug(QString debug);
+    void UpdatePositionNotifications();
+    void UpdatePositionLabel(qint64 position);
 
 };
 
@@ -0,0 +1,199 @@
+#include "playercontroller.h"
+#include "mainwindow.h"
+
+PlayerController::PlayerController(int player_index, bool threaded, MainWindow* main_window)
+{
+    this->main_window = main_window;
+    this->next_command = 0;
+    this->time_shifted = false;
+    this->muted = false;
+    this->snapshot.completed_command = 0;
+    this->snapshot.position_update = 0;
+    this->snapshot.failed_command = 0;
+    this->thread = nullptr;
+    this->player = new Player;
+
+    // Devices are passed to the player by queued calls
+    qRegisterMetaType<StreamBuffer*>("StreamBuffer*");
+    qRegisterMetaType<TimeShiftReader*>("TimeShiftReader*");
+    qRegisterMetaType<PackReader*>("PackReader*");
+
+    // Snapshots are always read from the GUI thread's event loop
+    QObject::connect(this->player, SIGNAL(SnapshotReady()), this, SLOT(OnSnapshotReady()), Qt::QueuedConnection);
+    QObject::connect(this->player, SIGNAL(Error(QString)), this, SLOT(OnError(QString)), Qt::QueuedConnection);
+
+    if (! threaded)
+    {
+        this->player->Setup(player_index);
+        return;
+    }
+
+    this->thread = new QThread(this);
+    this->thread->setObjectName("Player " + QString::number(player_index));
+    this->player->moveToThread(this->thread);
+    QObject::connect(this->thread, SIGNAL(finished()), this->player, SLOT(deleteLater()));
+    this->thread->start();
+
+    // Media objects must be created in the thread of the player
+    QMetaObject::invokeMethod(this->player, "Setup", Qt::BlockingQueuedConnection, Q_ARG(int, player_index));
+}
+
+int PlayerController::PrepareFlipTo(QUrl url, qint64 item_start, qint64 known_duration)
+{
+    int command = ++ this->next_command;
+    this->time_shifted = false;
+    QMetaObject::invokeMethod(this->player, "PrepareFlipToFile", Qt::QueuedConnection,
+                              Q_ARG(QUrl, url), Q_ARG(qint64, item_start), Q_ARG(qint64, known_duration), Q_ARG(int, command));
+    return command;
+}
+
+int PlayerController::PrepareFlipTo(StreamBuffer* stream)
+{
+    int command = ++ this->next_command;
+    this->time_shifted = false;
+    QMetaObject::invokeMethod(this->player, "PrepareFlipToStream", Qt::QueuedConnection,
+                              Q_ARG(StreamBuffer*, stream), Q_ARG(int, command));
+    return command;
+}
+
+int PlayerController::PrepareFlipTo(TimeShiftReader* reader)
+{
+    int command = ++ this->next_command;
+    this->time_shifted = true;
+    // Reader is read and deleted by the player
+    if (this->thread != nullptr)
+        reader->moveToThread(this->thread);
+    QMetaObject::invokeMethod(this->player, "PrepareFlipToTimeShift", Qt::QueuedConnection,
+                              Q_ARG(TimeShiftReader*, reader), Q_ARG(int, command));
+    return command;
+}
+
+int PlayerController::PrepareFlipTo(PackReader* reader)
+{
+    int command = ++ this->next_command;
+    this->time_shifted = false;
+    if (this->thread != nullptr)
+        reader->moveToThread(this->thread);
+    QMetaObject::invokeMethod(this->player, "PrepareFlipToPack", Qt::QueuedConnection,
+                              Q_ARG(PackReader*, reader), Q_ARG(qint64, this->main_window->GetStartupTime()), Q_ARG(int, command));
+    return command;
+}
+
+bool PlayerController::IsCommandComplete(int command)
+{
+    return this->snapshot.completed_command >= command;
+}
+
+bool PlayerController::HasCommandFailed(int command)
+{
+    return this->snapshot.failed_command == command;
+}
+
+bool PlayerController::IsTimeShifted()
+{
+    return this->time_shifted;
+}
+
+void PlayerController::Rewind(qint64 step)
+{
+    // Player moves the reader back in place, so nothing waits for the command
+    int command = ++ this->next_command;
+    QMetaObject::invokeMethod(this->player, "Rewind", Qt::QueuedConnection, Q_ARG(qint64, step), Q_ARG(int, command));
+}
+
+void PlayerController::FlipFrom(bool was_playing)
+{
+    // Player releases any device it was playing from
+    this->time_shifted = false;
+    QMetaObject::invokeMethod(this->player, "FlipFrom", Qt::QueuedConnection, Q_ARG(bool, was_playing));
+}
+
+void PlayerController::FlipTo(bool was_playing)
+{
+    QMetaObject::invokeMethod(this->player, "FlipTo", Qt::QueuedConnection,
+                              Q_ARG(bool, was_playing), Q_ARG(qint64, this->main_window->GetStartupTime()));
+}
+
+int PlayerController::Sync()
+{
+    int command = ++ this->next_command;
+    QMetaObject::invokeMethod(this->player, "Sync", Qt::QueuedConnection, Q_ARG(int, command));
+    return command;
+}
+
+void PlayerController::Play()
+{
+    // Timeline moves on by the time spent paused
+    QMetaObject::invokeMethod(this->player, "SetStartupTime", Qt::QueuedConnection,
+                              Q_ARG(qint64, this->main_window->GetStartupTime()));
+    QMetaObject::invokeMethod(this->player, "Play", Qt::QueuedConnection);
+}
+
+void PlayerController::Pause()
+{
+    QMetaObject::invokeMethod(this->player, "Pause", Qt::QueuedConnection);
+}
+
+void PlayerController::SetPosition()
+{
+    QMetaObject::invokeMethod(this->player, "SetPosition", Qt::QueuedConnection,
+                              Q_ARG(qint64, this->main_window->GetStartupTime()));
+}
+
+void PlayerController::SetLowPowerMode(bool low_power)
+{
+    QMetaObject::invokeMethod(this->player, "SetLowPowerMode", Qt::QueuedConnection, Q_ARG(bool, low_power));
+}
+
+void PlayerController::SetVolume(int volume)
+{
+    QMetaObject::invokeMethod(this->player, "SetVolume", Qt::QueuedConnection, Q_ARG(int, volume));
+}
+
+void PlayerController::SetMuted(bool muted)
+{
+    this->muted = muted;
+    QMetaObject::invokeMethod(this->player, "SetMuted", Qt::QueuedConnection, Q_ARG(bool, muted));
+}
+
+bool PlayerController::IsMuted()
+{
+    return this->muted;
+}
+
+QString PlayerController::GetMediaTitle()
+{
+    return this->snapshot.media_title;
+}
+
+QString PlayerController::GetMediaFileName()
+{
+    return this->snapshot.media_file_name;
+}
+
+void PlayerController::OnSnapshotReady()
+{
+    int last_position_update = this->snapshot.position_update;
+    this->snapshot = this->player->TakeSnapshot();
+    if (this->snapshot.position_update != last_position_update)
+        this->main_window->GetPositionLabel()->setText(this->snapshot.position_text);
+    emit SnapshotUpdated();
+}
+
+void PlayerController::OnError(QString error)
+{
+    this->main_window->DisplayError(error);
+}
+
+PlayerController::~PlayerController()
+{
+    if (this->thread == nullptr)
+    {
+        delete this->player;
+        return;
+    }
+
+    // Player is deleted in its own thread, once its event loop finishes
+    this->thread->quit();
+    this->thread->wait();
+}
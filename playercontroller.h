@@ -0,0 +1,68 @@
+#ifndef PLAYERCONTROLLER_H
+#define PLAYERCONTROLLER_H
+
+#include <QObject>
+#include <QThread>
+#include <QUrl>
+
+#include "player.h"
+
+class MainWindow;
+
+// GUI thread side of a player.
+// The player (and its media backend) runs in a worker thread, so
+// that loading, buffering and seeking do not block the GUI.
+// Preparing a station returns a command, which is complete once
+// SnapshotUpdated reports the player has loaded the station.
+class PlayerController : public QObject
+{
+    Q_OBJECT
+
+public:
+    PlayerController(int player_index, bool threaded, MainWindow* main_window);
+    ~PlayerController();
+
+    int PrepareFlipTo(QUrl url, qint64 item_start, qint64 known_duration = 0);
+    int PrepareFlipTo(StreamBuffer* stream);
+    // Player takes ownership of the reader
+    int PrepareFlipTo(TimeShiftReader* reader);
+    // Player takes ownership of the reader
+    int PrepareFlipTo(PackReader* reader);
+    bool IsCommandComplete(int command);
+    // Failed commands leave nothing loaded, so must not be flipped to
+    bool HasCommandFailed(int command);
+    bool IsTimeShifted();
+    void Rewind(qint64 step);
+    void FlipFrom(bool was_playing);
+    void FlipTo(bool was_playing);
+    // Completes once the player has run all commands sent before it,
+    // e.g. before devices it may be using are deleted.
+    int Sync();
+    void Play();
+    void Pause();
+    void SetPosition();
+    void SetLowPowerMode(bool low_power);
+    void SetVolume(int volume);
+    void SetMuted(bool muted);
+    bool IsMuted();
+    QString GetMediaTitle();
+    QString GetMediaFileName();
+
+signals:
+    void SnapshotUpdated();
+
+private slots:
+    void OnSnapshotReady();
+    void OnError(QString error);
+
+private:
+    MainWindow* main_window;
+    Player* player;
+    QThread* thread;
+    PlayerSnapshot snapshot;
+    int next_command;
+    bool time_shifted;
+    bool muted;
+};
+
+#endif // PLAYERCONTROLLER_H
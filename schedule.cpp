@@ -0,0 +1,126 @@
+#include "schedule.h"
+
+Schedule::Schedule()
+{
+    this->seed = 0;
+}
+
+void Schedule::SetSeed(quint64 seed)
+{
+    this->seed = seed;
+}
+
+void Schedule::AddInterstitial(ScheduleItemType type, QString file_path, qint64 duration)
+{
+    if (type == SCHEDULE_ITEM_MUSIC || duration <= 0)
+        return;
+
+    // Interstitial must leave room for music in the block
+    if (duration > (SCHEDULE_BLOCK_DURATION - SCHEDULE_MIN_MUSIC_DURATION))
+        return;
+
+    Interstitial interstitial;
+    interstitial.file_path = file_path;
+    interstitial.duration = duration;
+    this->pools[type].append(interstitial);
+}
+
+bool Schedule::HasInterstitials()
+{
+    for (int itx = 0; itx < INTERSTITIAL_POOL_COUNT; itx ++)
+        if (! this->pools[itx].isEmpty())
+            return true;
+    return false;
+}
+
+quint64 Schedule::Mix(quint64 value)
+{
+    // splitmix64 finaliser
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+quint64 Schedule::SeedFromString(QString value)
+{
+    // FNV-1a, which (unlike qHash) is stable between runs and Qt versions
+    quint64 hash = 0xcbf29ce484222325ULL;
+    QByteArray data = value.toUtf8();
+    for (int itx = 0; itx < data.size(); itx ++)
+    {
+        hash ^= static_cast<unsigned char>(data[itx]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+QString Schedule::GetPoolDirectoryName(ScheduleItemType type)
+{
+    switch (type)
+    {
+        case SCHEDULE_ITEM_JINGLE:
+            return INTERSTITIAL_DIR_JINGLES;
+        case SCHEDULE_ITEM_AD:
+            return INTERSTITIAL_DIR_ADS;
+        case SCHEDULE_ITEM_TALK:
+            return INTERSTITIAL_DIR_TALK;
+        default:
+            return QString();
+    }
+}
+
+const Schedule::Interstitial* Schedule::GetBlockInterstitial(qint64 block, ScheduleItemType& type)
+{
+    // Pick pool, then item within the pool, from a hash of the block number
+    quint64 pick = Schedule::Mix(this->seed ^ Schedule::Mix(static_cast<quint64>(block)));
+
+    int pool_count = 0;
+    int pool_indexes[INTERSTITIAL_POOL_COUNT];
+    for (int itx = 0; itx < INTERSTITIAL_POOL_COUNT; itx ++)
+        if (! this->pools[itx].isEmpty())
+            pool_indexes[pool_count ++] = itx;
+
+    int pool_index = pool_indexes[pick % pool_count];
+    const QList<Interstitial>& pool = this->pools[pool_index];
+    type = static_cast<ScheduleItemType>(pool_index);
+    return &pool[static_cast<int>((pick >> 32) % pool.size())];
+}
+
+ScheduleItem Schedule::GetItemAt(qint64 timeline_position)
+{
+    ScheduleItem item;
+    item.type = SCHEDULE_ITEM_MUSIC;
+    item.start = 0;
+    item.end = -1;
+
+    if (! this->HasInterstitials())
+        return item;
+
+    if (timeline_position < 0)
+        timeline_position = 0;
+
+    // Each block is a fixed length, so the block is found directly and
+    // the interstitial always sits at the end of it.
+    qint64 block = timeline_position / SCHEDULE_BLOCK_DURATION;
+    qint64 block_start = block * SCHEDULE_BLOCK_DURATION;
+    qint64 block_end = block_start + SCHEDULE_BLOCK_DURATION;
+
+    ScheduleItemType type;
+    const Interstitial* interstitial = this->GetBlockInterstitial(block, type);
+    qint64 break_start = block_end - interstitial->duration;
+
+    if (timeline_position >= break_start)
+    {
+        item.type = type;
+        item.file_path = interstitial->file_path;
+        item.start = break_start;
+        item.end = block_end;
+    }
+    else
+    {
+        item.start = block_start;
+        item.end = break_start;
+    }
+    return item;
+}
@@ -0,0 +1,72 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <QString>
+#include <QList>
+
+// Length (ms) of each block of the schedule. Each block is music,
+// followed by a single interstitial at the end of the block.
+#define SCHEDULE_BLOCK_DURATION 300000
+// Minimum amount of music (ms) in each block, interstitials longer
+// than the block minus this are ignored.
+#define SCHEDULE_MIN_MUSIC_DURATION 60000
+
+// Sub-directory names for each interstitial pool
+#define INTERSTITIAL_DIR_JINGLES "jingles"
+#define INTERSTITIAL_DIR_ADS "ads"
+#define INTERSTITIAL_DIR_TALK "talk"
+
+enum ScheduleItemType
+{
+    SCHEDULE_ITEM_JINGLE = 0,
+    SCHEDULE_ITEM_AD,
+    SCHEDULE_ITEM_TALK,
+    SCHEDULE_ITEM_MUSIC
+};
+#define INTERSTITIAL_POOL_COUNT 3
+
+// Item on air for a given point of the global timeline
+struct ScheduleItem
+{
+    ScheduleItemType type;
+    // File path of the item, empty for music (the station file)
+    QString file_path;
+    // Position of the global timeline that the item starts and ends.
+    // End is -1 for music that is never interrupted.
+    qint64 start;
+    qint64 end;
+};
+
+// Deterministic interstitial schedule for a station.
+// The item on air is a pure function of the global timeline
+// and the seed, so can be computed for any time without
+// building the schedule up to that point.
+class Schedule
+{
+
+public:
+    Schedule();
+
+    void SetSeed(quint64 seed);
+    void AddInterstitial(ScheduleItemType type, QString file_path, qint64 duration);
+    bool HasInterstitials();
+    ScheduleItem GetItemAt(qint64 timeline_position);
+
+    static quint64 SeedFromString(QString value);
+    static QString GetPoolDirectoryName(ScheduleItemType type);
+
+private:
+    struct Interstitial
+    {
+        QString file_path;
+        qint64 duration;
+    };
+
+    quint64 seed;
+    QList<Interstitial> pools[INTERSTITIAL_POOL_COUNT];
+
+    const Interstitial* GetBlockInterstitial(qint64 block, ScheduleItemType& type);
+    static quint64 Mix(quint64 value);
+};
+
+#endif // SCHEDULE_H
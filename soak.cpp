@@ -0,0 +1,253 @@
+#include "soak.h"
+
+#include <iostream>
+
+#include <QCoreApplication>
+#include <QTimer>
+#include <QSettings>
+#include <QFile>
+#include <QDir>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+#include "mainwindow.h"
+
+Soak::Soak(MainWindow* main_window, int retune_count)
+{
+    this->main_window = main_window;
+    this->retune_count = retune_count;
+    this->retunes = 0;
+    this->station_index = 0;
+    this->random.seed(SOAK_RANDOM_SEED);
+    this->window_latency = 0;
+    this->window_retunes = 0;
+    this->baseline_taken = false;
+    this->baseline_rss = -1;
+    this->baseline_fds = -1;
+    this->baseline_latency = 0;
+    this->retune_pending = false;
+    this->rejected_retunes = 0;
+
+    // Re-tuning continues in the event loop, so each step waits for it to finish
+    QObject::connect(this->main_window, SIGNAL(RetuneFinished(bool,qint64)), this, SLOT(OnRetuneFinished(bool,qint64)));
+}
+
+void Soak::PrepareSettings(QString settings_directory, QString station_directory, int worker_threads)
+{
+    // Keep the user's settings (volume, station, zones, etc.) untouched
+    // Native format is the registry on Windows, which setPath() cannot
+    // redirect, so the soak uses ini files throughout.
+    QSettings::setDefaultFormat(QSettings::IniFormat);
+    QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, settings_directory);
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope, ORGANISATION, APP_NAME);
+    settings.setValue(SETTINGS_KEY_DIRECTORY, station_directory);
+    if (worker_threads >= 0)
+        settings.setValue(SETTINGS_KEY_WORKER_THREADS, worker_threads);
+}
+
+bool Soak::WriteFixtures(QString directory, int station_count)
+{
+    QByteArray frame(SOAK_FIXTURE_FRAME_SIZE, '\0');
+    frame.replace(0, 4, SOAK_FIXTURE_FRAME_HEADER, 4);
+
+    for (int itx = 0; itx < station_count; itx ++)
+    {
+        // Lengths differ, so that stations are at different points of their loop
+        qint64 duration = SOAK_FIXTURE_DURATION + itx * 1000;
+        int frame_count = (int)(duration * SOAK_FIXTURE_SAMPLE_RATE / SOAK_FIXTURE_FRAME_SAMPLES / 1000);
+        QFile file(QDir(directory).filePath(QString("station-%1.mp3").arg(itx + 1)));
+        if (! file.open(QIODevice::WriteOnly))
+        {
+            std::cout << "Soak: unable to write fixture " << file.fileName().toStdString() << std::endl;
+            return false;
+        }
+        for (int frame_index = 0; frame_index < frame_count; frame_index ++)
+            file.write(frame);
+    }
+    return true;
+}
+
+void Soak::Start()
+{
+    // Steps are run from the event loop, which is not yet running
+    if (this->main_window->GetStationCount() < 2)
+        this->failure = "At least 2 stations are required";
+    else
+        std::cout << "Soak: starting " << this->retune_count << " retunes across "
+                  << this->main_window->GetStationCount() << " stations" << std::endl;
+    QTimer::singleShot(0, this, SLOT(Step()));
+}
+
+SoakMode Soak::GetMode()
+{
+    return static_cast<SoakMode>((this->retunes / SOAK_PHASE_RETUNES) % SOAK_MODE_COUNT);
+}
+
+int Soak::GetNextStation()
+{
+    int station_count = this->main_window->GetStationCount();
+    if (this->GetMode() == SOAK_MODE_SEQUENTIAL)
+        return (this->station_index + 1) % station_count;
+
+    // Always move to a different station
+    int offset = 1 + this->random.bounded(station_count - 1);
+    return (this->station_index + offset) % station_count;
+}
+
+int Soak::GetNextInterval()
+{
+    return this->GetMode() == SOAK_MODE_BURST ? SOAK_BURST_IDLE : SOAK_RETUNE_INTERVAL;
+}
+
+void Soak::Step()
+{
+    if (this->retunes >= this->retune_count || ! this->failure.isEmpty())
+    {
+        this->Finish();
+        return;
+    }
+
+    // Player may still be busy, e.g. with the initial station, so try again shortly
+    int station_index = this->GetNextStation();
+    if (! this->main_window->SelectStation(station_index))
+    {
+        QTimer::singleShot(SOAK_RETUNE_INTERVAL, this, SLOT(Step()));
+        return;
+    }
+    this->station_index = station_index;
+    this->retune_pending = true;
+
+    // Rest of the burst arrives whilst the player is re-tuning
+    if (this->GetMode() != SOAK_MODE_BURST)
+        return;
+    for (int itx = 1; itx < SOAK_BURST_SIZE; itx ++)
+    {
+        station_index = this->GetNextStation();
+        if (this->main_window->SelectStation(station_index))
+            this->station_index = station_index;
+        else
+            this->rejected_retunes ++;
+    }
+}
+
+void Soak::OnRetuneFinished(bool tuned, qint64 prepare_duration)
+{
+    // Ignore retunes not started by the soak
+    if (! this->retune_pending)
+        return;
+    this->retune_pending = false;
+
+    if (! tuned)
+    {
+        this->failure = "Unable to tune station " + QString::number(this->station_index);
+        this->Finish();
+        return;
+    }
+
+    // Only preparing the station counts, not the fixed dramatic pause
+    this->window_latency += prepare_duration;
+    this->window_retunes ++;
+    this->retunes ++;
+
+    if (this->retunes % SOAK_SAMPLE_INTERVAL == 0)
+    {
+        this->Sample();
+        if (! this->failure.isEmpty())
+        {
+            this->Finish();
+            return;
+        }
+    }
+
+    QTimer::singleShot(this->GetNextInterval(), this, SLOT(Step()));
+}
+
+void Soak::Sample()
+{
+    qint64 rss = Soak::GetResidentSize();
+    int fds = Soak::GetOpenFileCount();
+    double latency = this->window_retunes ? (double)this->window_latency / this->window_retunes : 0;
+    this->window_latency = 0;
+    this->window_retunes = 0;
+
+    std::cout << "Soak: retunes=" << this->retunes << " mode=" << this->GetMode()
+              << " rejected=" << this->rejected_retunes << " rss=" << rss << " fds=" << fds << " latency_ms=" << latency << std::endl;
+
+    if (! this->baseline_taken)
+    {
+        if (this->retunes < SOAK_WARMUP_RETUNES)
+            return;
+        this->baseline_rss = rss;
+        this->baseline_fds = fds;
+        this->baseline_latency = latency;
+        this->baseline_taken = true;
+        return;
+    }
+
+    // Resources cannot be read on all platforms, in which case they are -1
+    if (rss >= 0 && this->baseline_rss >= 0 && rss - this->baseline_rss > SOAK_MAX_RSS_GROWTH)
+        this->failure = "Resident memory grew by " + QString::number(rss - this->baseline_rss) + " bytes";
+    else if (fds >= 0 && this->baseline_fds >= 0 && fds - this->baseline_fds > SOAK_MAX_FD_GROWTH)
+        this->failure = "Open files grew by " + QString::number(fds - this->baseline_fds);
+    else if (this->baseline_latency > 0 && latency > this->baseline_latency * SOAK_MAX_LATENCY_DRIFT)
+        this->failure = "Retune latency drifted from " + QString::number(this->baseline_latency) + "ms to " + QString::number(latency) + "ms";
+}
+
+void Soak::PrintFrameLatency()
+{
+    // Lateness of GUI frames whilst re-tuning, for comparing worker threads with the GUI thread
+    MetricsHistogram* frame_latency = this->main_window->GetFrameLatencyMetric();
+    std::cout << "Soak: frame latency frames=" << frame_latency->GetCount()
+              << " mean_ms=" << (frame_latency->GetCount() ? (double)frame_latency->GetSum() / frame_latency->GetCount() : 0)
+              << " p50_ms=" << frame_latency->GetPercentile(50)
+              << " p99_ms=" << frame_latency->GetPercentile(99)
+              << " max_ms=" << frame_latency->GetPercentile(100) << std::endl;
+}
+
+void Soak::Finish()
+{
+    this->PrintFrameLatency();
+
+    if (this->failure.isEmpty())
+    {
+        std::cout << "Soak: passed after " << this->retunes << " retunes ("
+                  << this->rejected_retunes << " rejected in bursts)" << std::endl;
+        QCoreApplication::exit(0);
+        return;
+    }
+
+    std::cout << "Soak: failed after " << this->retunes << " retunes: " << this->failure.toStdString() << std::endl;
+    QCoreApplication::exit(1);
+}
+
+qint64 Soak::GetResidentSize()
+{
+#ifdef Q_OS_LINUX
+    // Second field is the number of resident pages
+    QFile statm("/proc/self/statm");
+    if (! statm.open(QIODevice::ReadOnly))
+        return -1;
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.count() < 2)
+        return -1;
+    return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+int Soak::GetOpenFileCount()
+{
+#ifdef Q_OS_LINUX
+    // Includes broken links (e.g. sockets and pipes), which are
+    // only listed as system entries.
+    QDir fd_directory("/proc/self/fd");
+    if (! fd_directory.exists())
+        return -1;
+    return fd_directory.entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot).count();
+#else
+    return -1;
+#endif
+}
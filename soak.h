@@ -0,0 +1,102 @@
+#ifndef SOAK_H
+#define SOAK_H
+
+#include <QObject>
+#include <QString>
+#include <QRandomGenerator>
+
+class MainWindow;
+
+#define SOAK_DEFAULT_RETUNES 20000
+// Retunes performed in each mode, before moving to the next mode
+#define SOAK_PHASE_RETUNES 500
+// Resources and latency are sampled after this many retunes
+#define SOAK_SAMPLE_INTERVAL 100
+// Samples taken before this many retunes are ignored, whilst
+// caches and backend state are warming up.
+#define SOAK_WARMUP_RETUNES 500
+// Delay (ms) between retunes, outside of bursts
+#define SOAK_RETUNE_INTERVAL 100
+// Station changes requested back to back in a burst, without waiting
+// for the player, and the idle time (ms) that follows each burst.
+#define SOAK_BURST_SIZE 10
+#define SOAK_BURST_IDLE 1000
+// Thresholds, relative to the first sample after warm up
+#define SOAK_MAX_RSS_GROWTH (64 * 1024 * 1024)
+#define SOAK_MAX_FD_GROWTH 16
+#define SOAK_MAX_LATENCY_DRIFT 1.5
+#define SOAK_RANDOM_SEED 1
+// Length (ms) of the first generated station, for running without
+// a directory of stations (e.g. in CI).
+#define SOAK_FIXTURE_DURATION 60000
+// Silent MPEG-1 layer III frame: 32kbps, 44.1kHz, mono, no padding.
+// Side information and main data are left zeroed, which decodes as silence.
+#define SOAK_FIXTURE_FRAME_HEADER "\xFF\xFB\x10\xC0"
+#define SOAK_FIXTURE_FRAME_SIZE 104
+#define SOAK_FIXTURE_FRAME_SAMPLES 1152
+#define SOAK_FIXTURE_SAMPLE_RATE 44100
+
+enum SoakMode {
+    SOAK_MODE_SEQUENTIAL = 0,
+    SOAK_MODE_RANDOM,
+    SOAK_MODE_BURST
+};
+#define SOAK_MODE_COUNT 3
+
+// Long running test of the player, which re-tunes between the
+// stations of a directory many times, in turn sequentially, randomly
+// and in bursts. Memory, open files and re-tune latency are sampled,
+// and the application exits with a failure if they grow too far.
+// Each burst requests several station changes at once, overlapping
+// the player's re-tune, of which all but the first should be rejected.
+class Soak : public QObject
+{
+    Q_OBJECT
+
+public:
+    Soak(MainWindow* main_window, int retune_count);
+
+    void Start();
+
+    // Use temporary settings, playing stations from the directory.
+    // Worker threads are left at the default if negative.
+    static void PrepareSettings(QString settings_directory, QString station_directory, int worker_threads);
+    // Write silent stations of slightly different lengths into the directory
+    static bool WriteFixtures(QString directory, int station_count);
+
+private slots:
+    void Step();
+    void OnRetuneFinished(bool tuned, qint64 prepare_duration);
+
+private:
+    MainWindow* main_window;
+    int retune_count;
+    int retunes;
+    int station_index;
+    QRandomGenerator random;
+    bool retune_pending;
+    // Station changes rejected by the player, whilst busy with a burst
+    int rejected_retunes;
+
+    // Latency of retunes since last sample
+    qint64 window_latency;
+    int window_retunes;
+
+    bool baseline_taken;
+    qint64 baseline_rss;
+    int baseline_fds;
+    double baseline_latency;
+    QString failure;
+
+    SoakMode GetMode();
+    int GetNextStation();
+    int GetNextInterval();
+    void Sample();
+    void PrintFrameLatency();
+    void Finish();
+
+    static qint64 GetResidentSize();
+    static int GetOpenFileCount();
+};
+
+#endif // SOAK_H
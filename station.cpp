@@ -0,0 +1,233 @@
+#include "station.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include <QDirIterator>
+
+#include "mp3info.h"
+
+Station::Station(QString file_path)
+{
+    this->file_path = file_path;
+    this->duration = 0;
+    this->stream_buffer = nullptr;
+    this->time_shift_buffer = nullptr;
+    this->time_shift_recorder = nullptr;
+    this->pack = nullptr;
+    this->pack_index = -1;
+
+    if (QFileInfo(file_path).suffix().toLower() == STREAM_STATION_EXTENSION)
+    {
+        this->LoadPlaylist();
+        return;
+    }
+
+    // Use title from tags as station name, falling back to file name.
+    // Duration is kept, so that the player does not need to
+    // wait for the backend to report it when tuning in.
+    Mp3Info info(file_path);
+    if (info.IsValid())
+        this->duration = info.GetDuration();
+    this->name = info.GetTitle();
+    if (this->name.isEmpty())
+        this->name = QFileInfo(file_path).completeBaseName();
+
+    // Seed schedule from file name, rather than full path, so that
+    // moving the directory of stations does not change the schedule.
+    this->schedule.SetSeed(Schedule::SeedFromString(QFileInfo(file_path).fileName()));
+    this->LoadInterstitials();
+}
+
+Station::Station(Pack* pack, int pack_index)
+{
+    this->file_path = pack->GetFilePath();
+    this->name = pack->GetStationName(pack_index);
+    this->duration = pack->GetStation(pack_index)->duration;
+    this->stream_buffer = nullptr;
+    this->time_shift_buffer = nullptr;
+    this->time_shift_recorder = nullptr;
+    this->pack = pack;
+    this->pack_index = pack_index;
+
+    // Original file name is kept in the pack, so the schedule is the
+    // same as before the station was packed. Interstitials are not packed.
+    this->schedule.SetSeed(Schedule::SeedFromString(pack->GetStationFileName(pack_index)));
+}
+
+QString Station::GetFilePath()
+{
+    return this->file_path;
+}
+
+void Station::LoadPlaylist()
+{
+    this->name = QFileInfo(this->file_path).completeBaseName();
+
+    QFile playlist(this->file_path);
+    if (! playlist.open(QIODevice::ReadOnly | QIODevice::Text))
+        return;
+
+    // Use first URL in playlist, with name from '#EXTINF:<duration>,<name>', if present
+    while (! playlist.atEnd())
+    {
+        QString line = QString::fromUtf8(playlist.readLine()).trimmed();
+        if (line.startsWith("#EXTINF:") && line.indexOf(',') != -1)
+        {
+            this->name = line.mid(line.indexOf(',') + 1).trimmed();
+        }
+        else if (! line.isEmpty() && ! line.startsWith('#'))
+        {
+            QUrl url(line);
+            if (url.scheme() != "http" && url.scheme() != "https")
+                continue;
+
+            // Connected once tuned to, and kept connected whilst
+            // recorded for time shift.
+            this->stream_buffer = new StreamBuffer(url);
+            return;
+        }
+    }
+    std::cout << "Warning: No stream URL found in: " << this->file_path.toStdString() << std::endl;
+}
+
+bool Station::IsStream()
+{
+    return this->stream_buffer != nullptr;
+}
+
+StreamBuffer* Station::GetStreamBuffer()
+{
+    return this->stream_buffer;
+}
+
+bool Station::IsPacked()
+{
+    return this->pack != nullptr;
+}
+
+Pack* Station::GetPack()
+{
+    return this->pack;
+}
+
+int Station::GetPackIndex()
+{
+    return this->pack_index;
+}
+
+void Station::EnableTimeShift(qint64 duration)
+{
+    // Recorder reads the station file, which packed stations do not have
+    if (this->time_shift_buffer != nullptr || this->IsPacked())
+        return;
+
+    // Streams are recorded as data is received, whereas files
+    // are recorded as the global timeline moves.
+    this->time_shift_buffer = new TimeShiftBuffer(duration);
+    if (this->IsStream())
+        this->stream_buffer->SetTimeShiftBuffer(this->time_shift_buffer);
+    else
+        this->time_shift_recorder = new TimeShiftRecorder(this->file_path, &this->schedule, this->time_shift_buffer);
+}
+
+void Station::DisableTimeShift()
+{
+    if (this->IsStream())
+        this->stream_buffer->SetTimeShiftBuffer(nullptr);
+    delete this->time_shift_recorder;
+    this->time_shift_recorder = nullptr;
+    delete this->time_shift_buffer;
+    this->time_shift_buffer = nullptr;
+}
+
+void Station::UpdateTimeShift(qint64 timeline_position)
+{
+    if (this->time_shift_recorder != nullptr)
+        this->time_shift_recorder->Update(timeline_position);
+}
+
+TimeShiftBuffer* Station::GetTimeShiftBuffer()
+{
+    return this->time_shift_buffer;
+}
+
+QString Station::GetName()
+{
+    return this->name;
+}
+
+qint64 Station::GetDuration()
+{
+    return this->duration;
+}
+
+Schedule* Station::GetSchedule()
+{
+    return &this->schedule;
+}
+
+void Station::LoadInterstitials()
+{
+    QFileInfo station_file(this->file_path);
+    QString pool_base = station_file.absolutePath() + "/" + station_file.completeBaseName() + "/";
+
+    for (int type = 0; type < INTERSTITIAL_POOL_COUNT; type ++)
+    {
+        QString pool_directory = pool_base + Schedule::GetPoolDirectoryName(static_cast<ScheduleItemType>(type));
+        if (! QDir(pool_directory).exists())
+            continue;
+
+        // Sort files, so that the pool order (and therefore the schedule)
+        // does not depend on the order the filesystem returns them.
+        QStringList files;
+        QDirIterator it(pool_directory, QStringList() << "*.mp3", QDir::Files);
+        while (it.hasNext())
+            files << it.next();
+        files.sort();
+
+        for (int itx = 0; itx < files.count(); itx ++)
+        {
+            Mp3Info info(files[itx]);
+            if (! info.IsValid())
+            {
+                std::cout << "Warning: Unable to read duration of interstitial: " << files[itx].toStdString() << std::endl;
+                continue;
+            }
+            this->schedule.AddInterstitial(static_cast<ScheduleItemType>(type), files[itx], info.GetDuration());
+        }
+    }
+}
+
+bool Station::IsInterstitialFile(QString file_path)
+{
+    // Interstitials live in '<station name>/<pool>/', alongside '<station name>.mp3'
+    QDir pool_directory = QFileInfo(file_path).dir();
+    QString pool_name = pool_directory.dirName();
+    if (pool_name != INTERSTITIAL_DIR_JINGLES && pool_name != INTERSTITIAL_DIR_ADS && pool_name != INTERSTITIAL_DIR_TALK)
+        return false;
+
+    QDir station_directory = pool_directory;
+    if (! station_directory.cdUp())
+        return false;
+    return QFileInfo::exists(station_directory.absolutePath() + ".mp3");
+}
+
+void Station::Preload(QString file_path, double position)
+{
+    QFile file(file_path);
+    if (! file.open(QIODevice::ReadOnly))
+        return;
+
+    // Contents are discarded, as only the OS cache is of use
+    file.read(STATION_PRELOAD_HEAD_SIZE);
+    qint64 offset = file.size() * std::min(std::max(position, 0.0), 1.0);
+    if (offset > STATION_PRELOAD_HEAD_SIZE && file.seek(offset))
+        file.read(STATION_PRELOAD_SIZE);
+}
+
+Station::~Station()
+{
+    this->DisableTimeShift();
+    delete this->stream_buffer;
+}
@@ -0,0 +1,74 @@
+#ifndef STATION_H
+#define STATION_H
+
+#include <QString>
+#include <QFileInfo>
+#include <QDir>
+
+#include "schedule.h"
+#include "streambuffer.h"
+#include "timeshift.h"
+#include "pack.h"
+
+// Extension of playlist files that define stream stations
+#define STREAM_STATION_EXTENSION "m3u"
+// Amount (bytes) read when preloading the start of a station file (tags
+// and headers), and from the position it will be played at.
+#define STATION_PRELOAD_HEAD_SIZE (64 * 1024)
+#define STATION_PRELOAD_SIZE (512 * 1024)
+
+// Radio station, made up of a station file, which is looped on the
+// global timeline, and optional pools of interstitials (jingles, ads
+// and talk) that are scheduled over the top of it.
+// Interstitials are read from sub-directories of a directory named
+// after the station file, e.g. for 'Flash.mp3': 'Flash/jingles/*.mp3'.
+// Stations can also be an HTTP MP3 stream, defined by an M3U playlist
+// containing the stream URL, or a station held in a station pack.
+class Station
+{
+
+public:
+    Station(QString file_path);
+    // Station held in a pack, which must outlive the station
+    Station(Pack* pack, int pack_index);
+    ~Station();
+
+    QString GetFilePath();
+    QString GetName();
+    qint64 GetDuration();
+    Schedule* GetSchedule();
+    bool IsStream();
+    StreamBuffer* GetStreamBuffer();
+    bool IsPacked();
+    Pack* GetPack();
+    int GetPackIndex();
+
+    // Time shift buffer, recording the station for rewinding
+    void EnableTimeShift(qint64 duration);
+    void DisableTimeShift();
+    void UpdateTimeShift(qint64 timeline_position);
+    TimeShiftBuffer* GetTimeShiftBuffer();
+
+    static bool IsInterstitialFile(QString file_path);
+    // Reads the part of a file that will be played from position (0-1)
+    // into the OS cache, so that a player loading it does not wait on
+    // the disk. Blocks, so is run in a worker thread.
+    static void Preload(QString file_path, double position);
+
+private:
+    QString file_path;
+    QString name;
+    // Duration (ms) of the station file, or 0 if unknown
+    qint64 duration;
+    Schedule schedule;
+    StreamBuffer* stream_buffer;
+    TimeShiftBuffer* time_shift_buffer;
+    TimeShiftRecorder* time_shift_recorder;
+    Pack* pack;
+    int pack_index;
+
+    void LoadInterstitials();
+    void LoadPlaylist();
+};
+
+#endif // STATION_H
@@ -0,0 +1,342 @@
+#include "stationdecoder.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#include <QDateTime>
+#include <QMutexLocker>
+
+#include "mp3info.h"
+#include "metrics.h"
+
+StationDecoder::StationDecoder(QString file_path, qint64 timeline_position)
+{
+    this->file_path = file_path;
+    this->source = nullptr;
+    this->decoder = nullptr;
+    this->start_position = -1;
+    this->pcm_start = 0;
+    this->pcm_processed = 0;
+    this->next_listener_id = 0;
+    this->stream_start_time = QDateTime::currentMSecsSinceEpoch();
+
+    Mp3Info info(file_path);
+    this->duration = info.GetDuration();
+    this->audio_start = info.GetAudioStart();
+    this->audio_end = info.GetAudioEnd();
+    this->pass_frames = this->duration * DECODER_SAMPLE_RATE / 1000;
+    this->pass_remaining = 0;
+    this->trim_remaining = 0;
+
+    // Without a LAME tag the delay is unknown, and the duration includes it
+    this->pass_trim = 0;
+    if (info.GetEncoderDelay() > 0 && info.GetSampleRate() > 0)
+        this->pass_trim = (qint64)(info.GetEncoderDelay() + DECODER_MP3_DELAY) * DECODER_SAMPLE_RATE / info.GetSampleRate();
+
+    this->dsp.Configure(DspSettings::LoadForStation(file_path), DECODER_SAMPLE_RATE);
+
+    if (! info.IsValid())
+    {
+        this->PrintDebug("Unable to read duration, station will be silent.");
+        return;
+    }
+    this->start_position = timeline_position >= 0 ? timeline_position % this->duration : 0;
+}
+
+void StationDecoder::Start()
+{
+    // Decoder is created in the worker thread, so its signals are
+    // handled there, rather than in the thread that created the station.
+    this->decoder = new QAudioDecoder(this);
+    this->decoder->setAudioFormat(StationDecoder::GetFormat());
+    QObject::connect(this->decoder, SIGNAL(bufferReady()), this, SLOT(OnBufferReady()));
+    QObject::connect(this->decoder, SIGNAL(finished()), this, SLOT(OnFinished()));
+    QObject::connect(this->decoder, SIGNAL(error(QAudioDecoder::Error)), this, SLOT(OnError(QAudioDecoder::Error)));
+
+    if (this->start_position >= 0)
+        this->StartDecoding(this->start_position);
+}
+
+QAudioFormat StationDecoder::GetFormat()
+{
+    QAudioFormat format;
+    format.setSampleRate(DECODER_SAMPLE_RATE);
+    format.setChannelCount(DECODER_CHANNELS);
+    format.setSampleSize(DECODER_SAMPLE_SIZE);
+    format.setSampleType(QAudioFormat::SignedInt);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setCodec("audio/pcm");
+    return format;
+}
+
+QString StationDecoder::GetFilePath()
+{
+    return this->file_path;
+}
+
+qint64 StationDecoder::BytesForDuration(qint64 duration)
+{
+    // Keep aligned to whole frames (a sample for each channel)
+    int frame_size = DECODER_CHANNELS * DECODER_SAMPLE_SIZE / 8;
+    return (duration * DECODER_SAMPLE_RATE / 1000) * frame_size;
+}
+
+qint64 StationDecoder::GetLiveIndex()
+{
+    return this->BytesForDuration(QDateTime::currentMSecsSinceEpoch() - this->stream_start_time);
+}
+
+void StationDecoder::StartDecoding(qint64 file_position)
+{
+    this->PrintDebug("Decoding from position: " + QString::number(file_position));
+
+    // Start decoding from the byte offset of the position, rather than
+    // decoding and discarding everything before it.
+    // This is exact for CBR files and approximate for VBR.
+    QFile* old_source = this->source;
+    this->source = new QFile(this->file_path, this);
+    this->source->open(QIODevice::ReadOnly);
+    this->source->seek(this->audio_start + (this->audio_end - this->audio_start) * file_position / this->duration);
+
+    this->decoder->setSourceDevice(this->source);
+    delete old_source;
+
+    // Encoder delay only precedes the first frame of the file
+    this->pass_remaining = this->pass_frames - file_position * DECODER_SAMPLE_RATE / 1000;
+    this->trim_remaining = file_position == 0 ? this->pass_trim : 0;
+    this->decoder->start();
+}
+
+void StationDecoder::AppendFrames(const char* data, qint64 frame_count)
+{
+    // Drop the encoder delay at the start of a pass, and the padding
+    // (or anything else) beyond the duration at the end.
+    int frame_size = DECODER_CHANNELS * DECODER_SAMPLE_SIZE / 8;
+    qint64 trimmed = std::min(this->trim_remaining, frame_count);
+    this->trim_remaining -= trimmed;
+    qint64 kept = std::min(frame_count - trimmed, this->pass_remaining);
+    if (kept <= 0)
+        return;
+    this->pcm.append(data + trimmed * frame_size, kept * frame_size);
+    this->pass_remaining -= kept;
+}
+
+void StationDecoder::OnBufferReady()
+{
+    this->decode_queued = 0;
+    if (this->decoder == nullptr)
+        return;
+    QMutexLocker locker(&this->mutex);
+
+    // Only decode a short distance ahead of the live position,
+    // leaving remaining buffers queued in the decoder until needed.
+    qint64 decode_limit = this->GetLiveIndex() + this->BytesForDuration(DECODER_DECODE_AHEAD);
+    while (this->decoder->bufferAvailable() && (this->pcm_start + this->pcm.size()) < decode_limit)
+    {
+        QAudioBuffer buffer = this->decoder->read();
+        this->AppendFrames(buffer.constData<char>(), buffer.frameCount());
+
+        // Pass is complete, so start the next one straight away, whilst
+        // the end of this one is still ahead of the live position.
+        if (this->pass_remaining <= 0)
+        {
+            this->decoder->stop();
+            this->StartDecoding(0);
+            break;
+        }
+    }
+
+    // Process whole frames once, for all listeners. A partial frame at
+    // the end is left until the rest of it has been decoded.
+    int frame_size = DECODER_CHANNELS * DECODER_SAMPLE_SIZE / 8;
+    qint64 frame_count = (this->pcm_start + this->pcm.size() - this->pcm_processed) / frame_size;
+    if (frame_count <= 0)
+        return;
+
+    // Processed outside the lock, so listeners are not held up. Only
+    // this thread appends or processes audio, and unprocessed audio is
+    // never trimmed, so the block is unchanged when it is copied back.
+    QByteArray block = this->pcm.mid(this->pcm_processed - this->pcm_start, frame_count * frame_size);
+    locker.unlock();
+    this->dsp.Process(reinterpret_cast<qint16*>(block.data()), frame_count);
+    locker.relock();
+    memcpy(this->pcm.data() + (this->pcm_processed - this->pcm_start), block.constData(), block.size());
+    this->pcm_processed += block.size();
+}
+
+void StationDecoder::OnFinished()
+{
+    QMutexLocker locker(&this->mutex);
+
+    // File ended short of the duration, so fill the rest of the pass
+    // with silence, keeping later passes on the global timeline.
+    if (this->pass_remaining > 0)
+    {
+        int frame_size = DECODER_CHANNELS * DECODER_SAMPLE_SIZE / 8;
+        this->pcm.append(QByteArray(this->pass_remaining * frame_size, 0));
+        this->pass_remaining = 0;
+    }
+
+    // Loop station from the start of the file
+    this->decoder->stop();
+    this->StartDecoding(0);
+}
+
+void StationDecoder::OnError(QAudioDecoder::Error error)
+{
+    this->PrintDebug("Error " + QString::number(error) + ": " + this->decoder->errorString());
+    static MetricsCounter* backend_errors_metric = Metrics::Instance()->GetCounter("gta_backend_errors_total", "Errors reported by the media backend");
+    backend_errors_metric->Increment();
+}
+
+int StationDecoder::AddListener()
+{
+    QMutexLocker locker(&this->mutex);
+
+    // New listeners start at the live position
+    int listener_id = this->next_listener_id ++;
+    this->listeners[listener_id] = this->GetLiveIndex();
+    return listener_id;
+}
+
+void StationDecoder::RemoveListener(int listener_id)
+{
+    QMutexLocker locker(&this->mutex);
+    this->listeners.remove(listener_id);
+}
+
+int StationDecoder::GetListenerCount()
+{
+    QMutexLocker locker(&this->mutex);
+    return this->listeners.count();
+}
+
+qint64 StationDecoder::Read(int listener_id, char* data, qint64 max_size)
+{
+    qint64 read_size = 0;
+    {
+        QMutexLocker locker(&this->mutex);
+        if (! this->listeners.contains(listener_id))
+            return 0;
+
+        // Listener that has fallen further behind the live position
+        // than is kept, e.g. whilst its output was stalled, rejoins it.
+        int frame_size = DECODER_CHANNELS * DECODER_SAMPLE_SIZE / 8;
+        qint64 cursor = this->listeners[listener_id];
+        qint64 live_index = this->GetLiveIndex();
+        if (cursor < live_index - this->BytesForDuration(DECODER_KEEP_BEHIND))
+            cursor = live_index;
+        cursor = std::max(cursor, this->pcm_start);
+
+        // Only whole, processed, frames are read, so listeners stay
+        // aligned. Silence stands in for audio that has not been decoded
+        // yet, and the listener still moves past it.
+        read_size = max_size - max_size % frame_size;
+        qint64 available = std::max(std::min(read_size, this->pcm_processed - cursor), (qint64)0);
+        if (available > 0)
+            memcpy(data, this->pcm.constData() + (cursor - this->pcm_start), available);
+        memset(data + available, 0, read_size - available);
+        this->listeners[listener_id] = cursor + read_size;
+
+        this->Trim();
+    }
+
+    // Decode further, now that audio has been consumed. This is done
+    // in the worker thread, rather than the thread of the output.
+    if (this->decode_queued.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(this, "OnBufferReady", Qt::QueuedConnection);
+    return read_size;
+}
+
+void StationDecoder::Trim()
+{
+    // Drop audio that has been read by all listeners and is
+    // further behind the live position than needs to be kept.
+    qint64 keep_from = this->GetLiveIndex() - this->BytesForDuration(DECODER_KEEP_BEHIND);
+    // Audio that has not yet been processed is always kept.
+    keep_from = std::min(keep_from, this->pcm_processed);
+    for (QMap<int, qint64>::const_iterator it = this->listeners.constBegin(); it != this->listeners.constEnd(); ++ it)
+        keep_from = std::min(keep_from, it.value());
+
+    qint64 trim_size = std::min(keep_from - this->pcm_start, (qint64)this->pcm.size());
+    if (trim_size <= 0)
+        return;
+    this->pcm.remove(0, trim_size);
+    this->pcm_start += trim_size;
+}
+
+void StationDecoder::PrintDebug(QString debug)
+{
+    std::cout << "Decoder " << this->file_path.toStdString() << ": " << debug.toStdString() << std::endl;
+}
+
+StationDecoder::~StationDecoder()
+{
+    if (this->decoder != nullptr)
+        this->decoder->stop();
+}
+
+DecoderPool::DecoderPool()
+{
+    for (int itx = 0; itx < std::max(QThread::idealThreadCount(), 1); itx ++)
+    {
+        QThread* thread = new QThread();
+        thread->start();
+        this->threads.append(thread);
+    }
+}
+
+QThread* DecoderPool::GetLeastBusyThread()
+{
+    QMap<QThread*, int> decoder_counts;
+    for (QMap<QString, StationDecoder*>::const_iterator it = this->decoders.constBegin(); it != this->decoders.constEnd(); ++ it)
+        decoder_counts[it.value()->thread()] ++;
+
+    QThread* least_busy = this->threads[0];
+    for (int itx = 1; itx < this->threads.count(); itx ++)
+        if (decoder_counts.value(this->threads[itx]) < decoder_counts.value(least_busy))
+            least_busy = this->threads[itx];
+    return least_busy;
+}
+
+StationDecoder* DecoderPool::Acquire(QString file_path, qint64 timeline_position)
+{
+    // Reuse decoder if station is already being played in another zone
+    if (this->decoders.contains(file_path))
+        return this->decoders[file_path];
+
+    StationDecoder* decoder = new StationDecoder(file_path, timeline_position);
+    decoder->moveToThread(this->GetLeastBusyThread());
+    QMetaObject::invokeMethod(decoder, "Start", Qt::QueuedConnection);
+    this->decoders[file_path] = decoder;
+    return decoder;
+}
+
+void DecoderPool::Release(StationDecoder* decoder)
+{
+    if (decoder->GetListenerCount() > 0)
+        return;
+
+    // Deleted in its worker thread, once any queued decoding has run
+    this->decoders.remove(decoder->GetFilePath());
+    decoder->deleteLater();
+}
+
+int DecoderPool::GetDecoderCount()
+{
+    return this->decoders.count();
+}
+
+DecoderPool::~DecoderPool()
+{
+    // Decoders are deleted by their threads as the threads finish
+    for (QMap<QString, StationDecoder*>::const_iterator it = this->decoders.constBegin(); it != this->decoders.constEnd(); ++ it)
+        it.value()->deleteLater();
+    for (int itx = 0; itx < this->threads.count(); itx ++)
+    {
+        this->threads[itx]->quit();
+        this->threads[itx]->wait();
+        delete this->threads[itx];
+    }
+}
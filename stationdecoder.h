@@ -0,0 +1,128 @@
+#ifndef STATIONDECODER_H
+#define STATIONDECODER_H
+
+#include <QObject>
+#include <QString>
+#include <QMap>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QThread>
+#include <QList>
+#include <QFile>
+#include <QAudioDecoder>
+#include <QAudioFormat>
+#include <QAudioBuffer>
+
+#include "dsp.h"
+
+// Format that all stations are decoded to, so decoded audio can be
+// shared between any number of outputs.
+#define DECODER_SAMPLE_RATE 44100
+#define DECODER_CHANNELS 2
+#define DECODER_SAMPLE_SIZE 16
+// Amount of audio (ms) decoded ahead of the live position
+#define DECODER_DECODE_AHEAD 2000
+// Amount of audio (ms) kept behind the live position
+#define DECODER_KEEP_BEHIND 1000
+// Samples of delay added by MP3 decoders, on top of the encoder delay
+#define DECODER_MP3_DELAY 529
+
+// Decodes a station file to PCM, following the global timeline.
+// Decoded audio is processed with the station's DSP chain, then held
+// once and read by any number of listeners (zones), each with its own
+// read position.
+// The station loops gaplessly: encoder delay and padding (LAME tag)
+// are trimmed, each pass lasts exactly the station duration, and the
+// next pass is decoded as soon as the current one has been, so it is
+// buffered well before the end is played.
+// Decoding and processing run in a worker thread of the decoder pool,
+// whereas listeners read from the threads of their outputs.
+class StationDecoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    StationDecoder(QString file_path, qint64 timeline_position);
+    ~StationDecoder();
+
+    QString GetFilePath();
+    int AddListener();
+    void RemoveListener(int listener_id);
+    int GetListenerCount();
+    // Fills whole frames, with silence where audio has not been decoded
+    // in time, so that every listener moves with the global timeline.
+    // Returns the size filled.
+    qint64 Read(int listener_id, char* data, qint64 max_size);
+
+    static QAudioFormat GetFormat();
+
+public slots:
+    // Starts decoding, once moved to its worker thread
+    void Start();
+
+private slots:
+    void OnBufferReady();
+    void OnFinished();
+    void OnError(QAudioDecoder::Error error);
+
+private:
+    QString file_path;
+    QAudioDecoder* decoder;
+    QFile* source;
+    qint64 duration;
+    qint64 audio_start;
+    qint64 audio_end;
+    qint64 start_position;
+    // Frames (at the decoder rate) in each pass of the station, trimmed
+    // from the start of each pass, and still to come in the current pass
+    qint64 pass_frames;
+    qint64 pass_trim;
+    qint64 pass_remaining;
+    qint64 trim_remaining;
+
+    // Decoded audio, with byte index in the stream of the first byte
+    QMutex mutex;
+    QByteArray pcm;
+    qint64 pcm_start;
+    // Stream index up to which audio has been processed, which is
+    // always a whole number of frames, and is all listeners can read.
+    qint64 pcm_processed;
+    DspChain dsp;
+    // Wall clock time at which stream index 0 is played
+    qint64 stream_start_time;
+    // Set whilst reads have asked the worker to decode further
+    QAtomicInt decode_queued;
+
+    int next_listener_id;
+    QMap<int, qint64> listeners;
+
+    qint64 GetLiveIndex();
+    qint64 BytesForDuration(qint64 duration);
+    void StartDecoding(qint64 file_position);
+    void AppendFrames(const char* data, qint64 frame_count);
+    void Trim();
+    void PrintDebug(QString debug);
+};
+
+// Shares decoders between zones, so each station is decoded once
+// however many zones are playing it. Decoders are spread across a
+// worker thread per core, each new decoder going to the least busy.
+class DecoderPool
+{
+
+public:
+    DecoderPool();
+    ~DecoderPool();
+
+    StationDecoder* Acquire(QString file_path, qint64 timeline_position);
+    void Release(StationDecoder* decoder);
+    int GetDecoderCount();
+
+private:
+    QMap<QString, StationDecoder*> decoders;
+    QList<QThread*> threads;
+
+    QThread* GetLeastBusyThread();
+};
+
+#endif // STATIONDECODER_H
@@ -0,0 +1,542 @@
+#include "streambuffer.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+
+#include <QCoreApplication>
+
+#include "mp3info.h"
+#include "metrics.h"
+
+StreamBuffer::StreamBuffer(QUrl url, QObject* parent) : QIODevice(parent), mutex(QMutex::Recursive)
+{
+    this->url = url;
+    this->reply = nullptr;
+    this->time_shift_buffer = nullptr;
+    this->reconnect_attempts = 0;
+    this->active = false;
+    this->rebuffering = true;
+    this->bitrate = 0;
+    this->last_arrival = -1;
+    this->mean_gap = 0;
+    this->jitter = 0;
+    this->underrun_boost = 0;
+
+    this->network_manager = new QNetworkAccessManager(this);
+
+    this->reconnect_timer = new QTimer(this);
+    this->reconnect_timer->setSingleShot(true);
+    QObject::connect(this->reconnect_timer, SIGNAL(timeout()), this, SLOT(Connect()));
+
+    // Servers may keep the connection open without sending anything
+    this->stall_timer = new QTimer(this);
+    this->stall_timer->setSingleShot(true);
+    QObject::connect(this->stall_timer, SIGNAL(timeout()), this, SLOT(OnStalled()));
+
+    // Unbuffered, as buffering is handled by this class
+    this->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    this->arrival_timer.start();
+}
+
+void StreamBuffer::Start()
+{
+    if (this->reply == nullptr && ! this->reconnect_timer->isActive())
+        this->Connect();
+}
+
+void StreamBuffer::Stop()
+{
+    // Player or time shift may have started using the stream since this was queued
+    QMutexLocker locker(&this->mutex);
+    if (this->active || this->time_shift_buffer != nullptr)
+        return;
+    this->buffer.clear();
+    this->rebuffering = true;
+    locker.unlock();
+
+    this->reconnect_timer->stop();
+    this->stall_timer->stop();
+    this->reconnect_attempts = 0;
+    if (this->reply == nullptr)
+        return;
+    this->PrintDebug("Disconnecting, as no longer in use.");
+    this->reply->disconnect(this);
+    this->reply->abort();
+    this->reply->deleteLater();
+    this->reply = nullptr;
+}
+
+void StreamBuffer::Connect()
+{
+    this->PrintDebug("Connecting.");
+    QNetworkRequest request(this->url);
+    // In-stream metadata would need to be stripped before decoding
+    request.setRawHeader("Icy-MetaData", "0");
+    request.setAttribute(QNetworkRequest::FollowRedirectsAttribute, true);
+
+    this->reply = this->network_manager->get(request);
+    this->last_arrival = -1;
+    QObject::connect(this->reply, SIGNAL(readyRead()), this, SLOT(OnReadyRead()));
+    QObject::connect(this->reply, SIGNAL(finished()), this, SLOT(OnFinished()));
+    this->stall_timer->start(STREAM_STALL_TIMEOUT);
+}
+
+void StreamBuffer::OnStalled()
+{
+    // Aborting finishes the reply, which reconnects
+    if (this->reply == nullptr)
+        return;
+    this->PrintDebug("No data received for " + QString::number(STREAM_STALL_TIMEOUT) + "ms.");
+    this->reply->abort();
+}
+
+void StreamBuffer::OnFinished()
+{
+    this->PrintDebug("Disconnected: " + this->reply->errorString());
+    this->stall_timer->stop();
+    this->reply->deleteLater();
+    this->reply = nullptr;
+
+    // Reconnect with exponential backoff, which is reset once data is received
+    qint64 delay = std::min((qint64)STREAM_RECONNECT_MIN_DELAY << std::min(this->reconnect_attempts, 16), (qint64)STREAM_RECONNECT_MAX_DELAY);
+    this->reconnect_attempts ++;
+    this->PrintDebug("Reconnecting in " + QString::number(delay) + "ms.");
+    this->reconnect_timer->start(delay);
+}
+
+void StreamBuffer::OnReadyRead()
+{
+    QByteArray data = this->reply->readAll();
+    if (data.isEmpty())
+        return;
+    this->reconnect_attempts = 0;
+    this->stall_timer->start(STREAM_STALL_TIMEOUT);
+
+    QMutexLocker locker(&this->mutex);
+
+    // Update inter-arrival statistics, using exponentially weighted
+    // moving averages of the gap between packets and its deviation.
+    qint64 now = this->arrival_timer.elapsed();
+    if (this->last_arrival >= 0)
+    {
+        double gap = now - this->last_arrival;
+        this->mean_gap += (gap - this->mean_gap) / 16.0;
+        this->jitter += (std::fabs(gap - this->mean_gap) - this->jitter) / 16.0;
+    }
+    this->last_arrival = now;
+    this->underrun_boost *= 0.999;
+
+    this->buffer.append(data);
+    if (this->time_shift_buffer != nullptr)
+        this->time_shift_buffer->Append(data);
+    if (this->bitrate == 0)
+        this->ReadBitrate();
+
+    // Whilst not playing, only keep the live tail of the stream.
+    // Whilst playing, limit the amount held if the reader falls behind.
+    this->TrimTo(this->active ? this->DurationToBytes(STREAM_BUFFER_RETAIN_DURATION) : this->GetTargetBytes());
+
+    if (this->rebuffering && this->buffer.size() >= this->GetTargetBytes())
+    {
+        this->PrintDebug("Buffered " + QString::number(this->GetBufferedDuration()) + "ms.");
+        this->rebuffering = false;
+    }
+
+    bool ready = this->active && ! this->rebuffering;
+    locker.unlock();
+    if (ready)
+        emit readyRead();
+}
+
+void StreamBuffer::ReadBitrate()
+{
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(this->buffer.constData());
+    Mp3FrameHeader header;
+    for (int offset = 0; offset + MP3_FRAME_HEADER_SIZE <= this->buffer.size(); offset ++)
+    {
+        if (Mp3Info::ParseFrameHeader(data + offset, header))
+        {
+            this->bitrate = header.bitrate;
+            this->PrintDebug("Bitrate: " + QString::number(this->bitrate));
+            return;
+        }
+    }
+}
+
+void StreamBuffer::SetActive(bool active)
+{
+    QMutexLocker locker(&this->mutex);
+    this->active = active;
+    if (active)
+    {
+        // Start from the live tail of the stream
+        this->TrimTo(this->GetTargetBytes());
+        if (this->buffer.size() < this->GetTargetBytes())
+            this->rebuffering = true;
+        // Connection is made in the thread of the buffer
+        QMetaObject::invokeMethod(this, "Start");
+    }
+    else if (this->time_shift_buffer == nullptr)
+    {
+        QMetaObject::invokeMethod(this, "Stop");
+    }
+}
+
+void StreamBuffer::SetTimeShiftBuffer(TimeShiftBuffer* time_shift_buffer)
+{
+    QMutexLocker locker(&this->mutex);
+    this->time_shift_buffer = time_shift_buffer;
+    // Recorded whether played or not, so connect now, before the
+    // station is tuned to.
+    if (time_shift_buffer != nullptr)
+        QMetaObject::invokeMethod(this, "Start");
+    else if (! this->active)
+        QMetaObject::invokeMethod(this, "Stop");
+}
+
+void StreamBuffer::TrimTo(qint64 max_bytes)
+{
+    if (this->buffer.size() <= max_bytes)
+        return;
+    this->buffer.remove(0, this->buffer.size() - max_bytes);
+
+    // Realign to the start of a frame, so the decoder does not
+    // have to resync on partial data.
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(this->buffer.constData());
+    Mp3FrameHeader header;
+    int offset = 0;
+    while (offset + MP3_FRAME_HEADER_SIZE <= this->buffer.size() && ! Mp3Info::ParseFrameHeader(data + offset, header))
+        offset ++;
+    this->buffer.remove(0, offset);
+}
+
+qint64 StreamBuffer::DurationToBytes(qint64 duration) const
+{
+    int bitrate = this->bitrate ? this->bitrate : STREAM_DEFAULT_BITRATE;
+    return duration * bitrate / 8000;
+}
+
+qint64 StreamBuffer::GetTargetDuration() const
+{
+    QMutexLocker locker(&this->mutex);
+    // Enough to cover a typical gap between packets, plus
+    // a margin for the variance in arrival times.
+    qint64 target = STREAM_BUFFER_MIN_DURATION + this->mean_gap + 4 * this->jitter + this->underrun_boost;
+    return std::min(target, (qint64)STREAM_BUFFER_MAX_DURATION);
+}
+
+qint64 StreamBuffer::GetTargetBytes() const
+{
+    return this->DurationToBytes(this->GetTargetDuration());
+}
+
+qint64 StreamBuffer::GetBufferedDuration() const
+{
+    QMutexLocker locker(&this->mutex);
+    int bitrate = this->bitrate ? this->bitrate : STREAM_DEFAULT_BITRATE;
+    return this->buffer.size() * 8000 / bitrate;
+}
+
+QUrl StreamBuffer::GetUrl()
+{
+    return this->url;
+}
+
+bool StreamBuffer::isSequential() const
+{
+    return true;
+}
+
+qint64 StreamBuffer::bytesAvailable() const
+{
+    QMutexLocker locker(&this->mutex);
+    if (this->rebuffering)
+        return QIODevice::bytesAvailable();
+    return this->buffer.size() + QIODevice::bytesAvailable();
+}
+
+qint64 StreamBuffer::readData(char* data, qint64 max_size)
+{
+    QMutexLocker locker(&this->mutex);
+    if (this->rebuffering)
+        return 0;
+
+    if (this->buffer.isEmpty())
+    {
+        // Reader has caught up with the stream, so increase the
+        // target depth and wait for it to fill before continuing.
+        this->PrintDebug("Underrun.");
+        this->underrun_boost = std::min(this->underrun_boost + STREAM_BUFFER_UNDERRUN_STEP, (double)STREAM_BUFFER_MAX_DURATION);
+        this->rebuffering = true;
+        static MetricsCounter* underrun_metric = Metrics::Instance()->GetCounter(
+            "gta_buffer_underruns_total", "Buffer underruns during playback", "source=\"stream\"");
+        underrun_metric->Increment();
+        locker.unlock();
+        emit Underrun();
+        return 0;
+    }
+
+    qint64 read_size = std::min(max_size, (qint64)this->buffer.size());
+    memcpy(data, this->buffer.constData(), read_size);
+    this->buffer.remove(0, read_size);
+    return read_size;
+}
+
+qint64 StreamBuffer::writeData(const char* data, qint64 max_size)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(max_size);
+    return -1;
+}
+
+void StreamBuffer::PrintDebug(QString debug)
+{
+    std::cout << "Stream " << this->url.toString().toStdString() << ": " << debug.toStdString() << std::endl;
+}
+
+StreamTestServer::StreamTestServer(QObject* parent) : QObject(parent)
+{
+    this->bitrate = STREAM_DEFAULT_BITRATE;
+    this->rate = 1;
+    this->connection_count = 0;
+    this->server = new QTcpServer(this);
+    QObject::connect(this->server, SIGNAL(newConnection()), this, SLOT(OnNewConnection()));
+    this->send_timer = new QTimer(this);
+    this->send_timer->setTimerType(Qt::PreciseTimer);
+    QObject::connect(this->send_timer, SIGNAL(timeout()), this, SLOT(OnSend()));
+}
+
+bool StreamTestServer::Load(QString file_path)
+{
+    // Only the audio is sent, as a stream would not include tags
+    Mp3Info info(file_path);
+    QFile file(file_path);
+    if (! info.IsValid() || ! file.open(QIODevice::ReadOnly))
+        return false;
+    file.seek(info.GetAudioStart());
+    this->audio = file.read(info.GetAudioEnd() - info.GetAudioStart());
+
+    Mp3FrameHeader header;
+    if (this->audio.size() < MP3_FRAME_HEADER_SIZE ||
+        ! Mp3Info::ParseFrameHeader(reinterpret_cast<const unsigned char*>(this->audio.constData()), header))
+        return false;
+    this->bitrate = header.bitrate;
+    return true;
+}
+
+bool StreamTestServer::Listen()
+{
+    if (! this->server->listen(QHostAddress::LocalHost))
+        return false;
+    this->send_timer->start(STREAM_TEST_INTERVAL);
+    return true;
+}
+
+QUrl StreamTestServer::GetUrl()
+{
+    return QUrl("http://127.0.0.1:" + QString::number(this->server->serverPort()) + "/");
+}
+
+int StreamTestServer::GetBitrate()
+{
+    return this->bitrate;
+}
+
+int StreamTestServer::GetConnectionCount()
+{
+    return this->connection_count;
+}
+
+void StreamTestServer::SetRate(double rate)
+{
+    this->rate = rate;
+}
+
+void StreamTestServer::Stall()
+{
+    this->stalled_clients.append(this->clients);
+}
+
+void StreamTestServer::DisconnectClients()
+{
+    // Aborting removes the client from the list
+    QList<QTcpSocket*> clients = this->clients;
+    for (int itx = 0; itx < clients.count(); itx ++)
+        clients[itx]->abort();
+}
+
+void StreamTestServer::OnNewConnection()
+{
+    while (this->server->hasPendingConnections())
+    {
+        // Request is not read, as every path is the same stream
+        QTcpSocket* socket = this->server->nextPendingConnection();
+        QObject::connect(socket, SIGNAL(disconnected()), this, SLOT(OnDisconnected()));
+        socket->write("HTTP/1.0 200 OK\r\nContent-Type: audio/mpeg\r\nicy-name: Stream test\r\n\r\n");
+        this->clients.append(socket);
+        this->offsets.append(0);
+        this->connection_count ++;
+    }
+}
+
+void StreamTestServer::OnDisconnected()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(this->sender());
+    int client = this->clients.indexOf(socket);
+    if (client >= 0)
+    {
+        this->clients.removeAt(client);
+        this->offsets.removeAt(client);
+    }
+    this->stalled_clients.removeAll(socket);
+    socket->deleteLater();
+}
+
+void StreamTestServer::OnSend()
+{
+    qint64 send_size = this->bitrate / 8 * STREAM_TEST_INTERVAL / 1000 * this->rate;
+    for (int itx = 0; itx < this->clients.count(); itx ++)
+    {
+        QTcpSocket* socket = this->clients[itx];
+        if (this->stalled_clients.contains(socket))
+            continue;
+
+        for (qint64 remaining = send_size; remaining > 0;)
+        {
+            qint64 chunk_size = std::min(remaining, this->audio.size() - this->offsets[itx]);
+            socket->write(this->audio.constData() + this->offsets[itx], chunk_size);
+            this->offsets[itx] = (this->offsets[itx] + chunk_size) % this->audio.size();
+            remaining -= chunk_size;
+        }
+    }
+}
+
+StreamTest::StreamTest(QString file_path)
+{
+    this->file_path = file_path;
+    this->server = new StreamTestServer(this);
+    this->stream = nullptr;
+    this->phase = STREAM_TEST_PHASE_NORMAL;
+    this->phase_read = 0;
+    this->phase_underruns = 0;
+    this->phase_connections = 0;
+    this->read_timer = new QTimer(this);
+    this->read_timer->setTimerType(Qt::PreciseTimer);
+    QObject::connect(this->read_timer, SIGNAL(timeout()), this, SLOT(OnRead()));
+}
+
+void StreamTest::Start()
+{
+    if (! this->server->Load(this->file_path) || ! this->server->Listen())
+    {
+        this->failure = "Unable to serve " + this->file_path;
+        QTimer::singleShot(0, this, SLOT(Finish()));
+        return;
+    }
+
+    std::cout << "Stream test: serving " << this->file_path.toStdString() << " at "
+              << this->server->GetUrl().toString().toStdString() << std::endl;
+    this->stream = new StreamBuffer(this->server->GetUrl(), this);
+    QObject::connect(this->stream, SIGNAL(Underrun()), this, SLOT(OnUnderrun()));
+    this->stream->SetActive(true);
+    this->read_timer->start(STREAM_TEST_INTERVAL);
+    QTimer::singleShot(STREAM_TEST_PHASE_DURATION, this, SLOT(NextPhase()));
+}
+
+void StreamTest::OnRead()
+{
+    // Read at the rate the audio would be played
+    QByteArray data = this->stream->read(this->server->GetBitrate() / 8 * STREAM_TEST_INTERVAL / 1000);
+    this->phase_read += data.size();
+}
+
+void StreamTest::OnUnderrun()
+{
+    this->phase_underruns ++;
+}
+
+QString StreamTest::GetPhaseName(int phase)
+{
+    switch (phase)
+    {
+    case STREAM_TEST_PHASE_NORMAL:
+        return "normal";
+    case STREAM_TEST_PHASE_THROTTLED:
+        return "throttled";
+    case STREAM_TEST_PHASE_RECOVERY:
+        return "recovery";
+    case STREAM_TEST_PHASE_DISCONNECTED:
+        return "disconnected";
+    default:
+        return "stalled";
+    }
+}
+
+void StreamTest::ReportPhase()
+{
+    int connections = this->server->GetConnectionCount() - this->phase_connections;
+    std::cout << "Stream test: phase=" << GetPhaseName(this->phase).toStdString()
+              << " read_bytes=" << this->phase_read << " underruns=" << this->phase_underruns
+              << " connections=" << connections << " target_ms=" << this->stream->GetTargetDuration() << std::endl;
+
+    // Audio must keep arriving after each fault has been cleared,
+    // and the buffer must reconnect after a disconnect or stall.
+    QString phase_name = GetPhaseName(this->phase);
+    if (this->phase_read == 0)
+        this->failure = "No audio read whilst " + phase_name;
+    else if (this->phase == STREAM_TEST_PHASE_THROTTLED && this->phase_underruns == 0)
+        this->failure = "No underruns whilst throttled";
+    else if ((this->phase == STREAM_TEST_PHASE_DISCONNECTED || this->phase == STREAM_TEST_PHASE_STALLED) && connections == 0)
+        this->failure = "Did not reconnect whilst " + phase_name;
+
+    this->phase_read = 0;
+    this->phase_underruns = 0;
+    this->phase_connections = this->server->GetConnectionCount();
+}
+
+void StreamTest::NextPhase()
+{
+    this->ReportPhase();
+    this->phase ++;
+    if (! this->failure.isEmpty() || this->phase == STREAM_TEST_PHASE_COUNT)
+    {
+        this->Finish();
+        return;
+    }
+
+    if (this->phase == STREAM_TEST_PHASE_THROTTLED)
+        this->server->SetRate(STREAM_TEST_THROTTLE_RATE);
+    else if (this->phase == STREAM_TEST_PHASE_RECOVERY)
+        this->server->SetRate(1);
+    else if (this->phase == STREAM_TEST_PHASE_DISCONNECTED)
+        this->server->DisconnectClients();
+    else if (this->phase == STREAM_TEST_PHASE_STALLED)
+        this->server->Stall();
+    QTimer::singleShot(STREAM_TEST_PHASE_DURATION, this, SLOT(NextPhase()));
+}
+
+void StreamTest::Finish()
+{
+    this->read_timer->stop();
+    if (this->failure.isEmpty())
+    {
+        std::cout << "Stream test: passed" << std::endl;
+        QCoreApplication::exit(0);
+        return;
+    }
+
+    std::cout << "Stream test: failed: " << this->failure.toStdString() << std::endl;
+    QCoreApplication::exit(1);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    if (this->reply != nullptr)
+    {
+        this->reply->disconnect(this);
+        this->reply->abort();
+        this->reply->deleteLater();
+    }
+}
@@ -0,0 +1,195 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <QIODevice>
+#include <QUrl>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QMutex>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QList>
+
+#include "timeshift.h"
+
+// Bounds (ms of audio) for the amount of stream held before playback
+#define STREAM_BUFFER_MIN_DURATION 500
+#define STREAM_BUFFER_MAX_DURATION 10000
+// Amount of audio (ms) added to the target after each underrun
+#define STREAM_BUFFER_UNDERRUN_STEP 1000
+// Maximum amount of audio (ms) held whilst the stream is being played
+#define STREAM_BUFFER_RETAIN_DURATION 60000
+// Bitrate assumed until the first frame header has been read
+#define STREAM_DEFAULT_BITRATE 128000
+// Reconnect backoff bounds (ms)
+#define STREAM_RECONNECT_MIN_DELAY 500
+#define STREAM_RECONNECT_MAX_DELAY 30000
+// Time (ms) without receiving any data before reconnecting
+#define STREAM_STALL_TIMEOUT 5000
+// Interval (ms) at which the stream test server sends, and the test reads, audio
+#define STREAM_TEST_INTERVAL 100
+// Duration (ms) of each phase of the stream test
+#define STREAM_TEST_PHASE_DURATION 8000
+// Rate, relative to real time, that the server sends at whilst throttled
+#define STREAM_TEST_THROTTLE_RATE 0.5
+
+// Sequential device, fed from an HTTP (Icecast/Shoutcast style) MP3 stream,
+// that is used as the media source of a player.
+// Incoming data is held in a jitter buffer, whose target depth adapts to the
+// measured variance of packet arrival times and to underruns.
+// Whilst not being played, only the most recent target depth of audio is kept,
+// so that playback starts immediately from the live tail of the stream.
+// The stream is only connected whilst it is being played, or recorded for
+// time shift, so recently played stations resume from a full buffer
+// without every stream in the directory being downloaded.
+// The network connection lives in the thread the buffer was created in,
+// whereas the buffer may be read from the thread of a player.
+class StreamBuffer : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    StreamBuffer(QUrl url, QObject* parent = nullptr);
+    ~StreamBuffer();
+
+    void SetActive(bool active);
+    void SetTimeShiftBuffer(TimeShiftBuffer* time_shift_buffer);
+    QUrl GetUrl();
+    qint64 GetTargetDuration() const;
+    qint64 GetBufferedDuration() const;
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+
+public slots:
+    void Start();
+    void Stop();
+
+signals:
+    void Underrun();
+
+protected:
+    qint64 readData(char* data, qint64 max_size) override;
+    qint64 writeData(const char* data, qint64 max_size) override;
+
+private slots:
+    void OnReadyRead();
+    void OnFinished();
+    void OnStalled();
+    void Connect();
+
+private:
+    QUrl url;
+    QNetworkAccessManager* network_manager;
+    QNetworkReply* reply;
+    QTimer* reconnect_timer;
+    QTimer* stall_timer;
+    int reconnect_attempts;
+
+    // Guards the buffer and its statistics
+    mutable QMutex mutex;
+    QByteArray buffer;
+    TimeShiftBuffer* time_shift_buffer;
+    bool active;
+    bool rebuffering;
+    int bitrate;
+
+    // Arrival statistics (ms), used to size the buffer
+    QElapsedTimer arrival_timer;
+    qint64 last_arrival;
+    double mean_gap;
+    double jitter;
+    double underrun_boost;
+
+    qint64 DurationToBytes(qint64 duration) const;
+    qint64 GetTargetBytes() const;
+    void TrimTo(qint64 max_bytes);
+    void ReadBitrate();
+    void PrintDebug(QString debug);
+};
+
+// Local stand-in for an internet radio server, which loops an MP3
+// file at its bitrate, and can be throttled, stalled or disconnected.
+class StreamTestServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    StreamTestServer(QObject* parent = nullptr);
+
+    bool Load(QString file_path);
+    bool Listen();
+    QUrl GetUrl();
+    int GetBitrate();
+    int GetConnectionCount();
+    // Rate, relative to real time, to send audio at
+    void SetRate(double rate);
+    // Stops sending to connected clients, without disconnecting them
+    void Stall();
+    void DisconnectClients();
+
+private slots:
+    void OnNewConnection();
+    void OnDisconnected();
+    void OnSend();
+
+private:
+    QTcpServer* server;
+    QTimer* send_timer;
+    QByteArray audio;
+    int bitrate;
+    double rate;
+    int connection_count;
+    QList<QTcpSocket*> clients;
+    QList<QTcpSocket*> stalled_clients;
+    // Offset in the audio of each client, which loops
+    QList<qint64> offsets;
+};
+
+// Test of a stream buffer against the test server, reading at real
+// time whilst the server is throttled, disconnected and stalled, and
+// checking the buffer recovers from each.
+class StreamTest : public QObject
+{
+    Q_OBJECT
+
+public:
+    StreamTest(QString file_path);
+
+    void Start();
+
+private slots:
+    void OnRead();
+    void OnUnderrun();
+    void NextPhase();
+    void Finish();
+
+private:
+    enum Phase
+    {
+        STREAM_TEST_PHASE_NORMAL,
+        STREAM_TEST_PHASE_THROTTLED,
+        STREAM_TEST_PHASE_RECOVERY,
+        STREAM_TEST_PHASE_DISCONNECTED,
+        STREAM_TEST_PHASE_STALLED,
+        STREAM_TEST_PHASE_COUNT
+    };
+    QString file_path;
+    StreamTestServer* server;
+    StreamBuffer* stream;
+    QTimer* read_timer;
+    int phase;
+    qint64 phase_read;
+    int phase_underruns;
+    int phase_connections;
+    QString failure;
+
+    static QString GetPhaseName(int phase);
+    void ReportPhase();
+};
+
+#endif // STREAMBUFFER_H
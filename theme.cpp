@@ -0,0 +1,143 @@
+#include "theme.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include <QApplication>
+#include <QFile>
+
+ThemeLibrary::ThemeLibrary()
+{
+}
+
+void ThemeLibrary::Load(QString file_path)
+{
+    if (! QFile::exists(file_path))
+        return;
+
+    QSettings source(file_path, QSettings::IniFormat);
+    QStringList ids = source.childGroups();
+    for (int itx = 0; itx < ids.count(); itx ++)
+    {
+        Theme theme = ThemeLibrary::Compile(source, ids[itx]);
+
+        // Themes loaded later (i.e. user themes) replace those with the same ID
+        bool replaced = false;
+        for (int theme_itx = 0; theme_itx < this->themes.count(); theme_itx ++)
+        {
+            if (this->themes[theme_itx].id == theme.id)
+            {
+                this->themes[theme_itx] = theme;
+                replaced = true;
+            }
+        }
+        if (! replaced)
+            this->themes.append(theme);
+        std::cout << "Loaded theme: " << theme.id.toStdString() << std::endl;
+    }
+
+    std::stable_sort(this->themes.begin(), this->themes.end(), [](const Theme& a, const Theme& b) {
+        return a.order < b.order;
+    });
+}
+
+bool ThemeLibrary::ReadColour(QSettings& source, QString key, QColor& colour)
+{
+    QString value = source.value(key, "").toString();
+    if (value.isEmpty())
+        return false;
+
+    colour = QColor(value);
+    if (! colour.isValid())
+    {
+        std::cout << "Warning: Invalid colour for theme " << source.group().toStdString() << ": " << key.toStdString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+Theme ThemeLibrary::Compile(QSettings& source, QString id)
+{
+    Theme theme;
+    QPalette base = QApplication::palette();
+    QColor colour;
+
+    source.beginGroup(id);
+    theme.id = id;
+    theme.name = source.value("name", id).toString();
+    theme.order = source.value("order", 100).toInt();
+    theme.display_margin = source.value("display_margin", 0).toInt();
+    theme.styled = false;
+
+    theme.window_palette = base;
+    if (ThemeLibrary::ReadColour(source, "window", colour))
+    {
+        theme.window_palette.setColor(QPalette::Window, colour);
+        theme.styled = true;
+    }
+
+    theme.button_palette = theme.window_palette;
+    if (ThemeLibrary::ReadColour(source, "button", colour))
+    {
+        theme.button_palette.setColor(QPalette::Button, colour);
+        theme.styled = true;
+    }
+    if (ThemeLibrary::ReadColour(source, "button_text", colour))
+    {
+        theme.button_palette.setColor(QPalette::ButtonText, colour);
+        theme.styled = true;
+    }
+
+    theme.dial_palette = theme.window_palette;
+    if (ThemeLibrary::ReadColour(source, "dial", colour))
+    {
+        theme.dial_palette.setColor(QPalette::Button, colour);
+        theme.styled = true;
+    }
+
+    theme.display_background_palette = theme.window_palette;
+    if (ThemeLibrary::ReadColour(source, "display_background", colour))
+    {
+        theme.display_background_palette.setColor(QPalette::Window, colour);
+        theme.styled = true;
+    }
+    if (ThemeLibrary::ReadColour(source, "display_text", colour))
+    {
+        theme.display_background_palette.setColor(QPalette::WindowText, colour);
+        theme.styled = true;
+    }
+
+    // Station name and position default to the display colours
+    theme.station_palette = theme.display_background_palette;
+    if (ThemeLibrary::ReadColour(source, "station_background", colour))
+        theme.station_palette.setColor(QPalette::Window, colour);
+    if (ThemeLibrary::ReadColour(source, "station_text", colour))
+        theme.station_palette.setColor(QPalette::WindowText, colour);
+
+    theme.position_palette = theme.display_background_palette;
+    if (ThemeLibrary::ReadColour(source, "position_background", colour))
+        theme.position_palette.setColor(QPalette::Window, colour);
+    if (ThemeLibrary::ReadColour(source, "position_text", colour))
+        theme.position_palette.setColor(QPalette::WindowText, colour);
+
+    source.endGroup();
+    return theme;
+}
+
+QList<Theme> ThemeLibrary::GetThemes()
+{
+    return this->themes;
+}
+
+bool ThemeLibrary::GetTheme(QString id, Theme& theme)
+{
+    for (int itx = 0; itx < this->themes.count(); itx ++)
+    {
+        if (this->themes[itx].id == id)
+        {
+            theme = this->themes[itx];
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+#ifndef THEME_H
+#define THEME_H
+
+#include <QString>
+#include <QList>
+#include <QPalette>
+#include <QSettings>
+
+// Themes bundled with the application
+#define THEME_RESOURCE_FILE ":/themes.ini"
+// User themes file, in the same directory as the settings file
+#define THEME_USER_FILE_NAME "gta-radio-player-themes.ini"
+
+// UI theme, compiled from the themes file into palettes,
+// so that switching theme is just swapping palettes.
+struct Theme
+{
+    QString id;
+    QString name;
+    int order;
+    // Plain themes use the platform palette and style
+    bool styled;
+    int display_margin;
+
+    QPalette window_palette;
+    QPalette button_palette;
+    QPalette dial_palette;
+    QPalette display_background_palette;
+    QPalette station_palette;
+    QPalette position_palette;
+};
+
+// Loads themes from bundled and user theme files
+class ThemeLibrary
+{
+
+public:
+    ThemeLibrary();
+
+    void Load(QString file_path);
+    QList<Theme> GetThemes();
+    bool GetTheme(QString id, Theme& theme);
+
+private:
+    QList<Theme> themes;
+
+    static Theme Compile(QSettings& source, QString id);
+    static bool ReadColour(QSettings& source, QString key, QColor& colour);
+};
+
+#endif // THEME_H
@@ -0,0 +1,362 @@
+#include "timeshift.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#include "mp3info.h"
+
+TimeShiftBuffer::TimeShiftBuffer(qint64 max_duration, QObject* parent) : QObject(parent), mutex(QMutex::Recursive)
+{
+    this->max_duration = max_duration;
+    this->data_offset = 0;
+    this->live_time = 0;
+}
+
+void TimeShiftBuffer::Append(const QByteArray& new_data)
+{
+    QMutexLocker locker(&this->mutex);
+    this->pending.append(new_data);
+
+    // Split data into frames, holding back any partial frame
+    const unsigned char* pending_data = reinterpret_cast<const unsigned char*>(this->pending.constData());
+    Mp3FrameHeader header;
+    int offset = 0;
+    bool appended = false;
+    while (offset + MP3_FRAME_HEADER_SIZE <= this->pending.size())
+    {
+        if (! Mp3Info::ParseFrameHeader(pending_data + offset, header))
+        {
+            offset ++;
+            continue;
+        }
+        if (offset + header.frame_size > this->pending.size())
+            break;
+
+        Frame frame;
+        frame.offset = this->data_offset + this->data.size();
+        frame.time = this->live_time;
+        this->frames.append(frame);
+        this->data.append(this->pending.constData() + offset, header.frame_size);
+        this->live_time += header.samples_per_frame * 1000.0 / header.sample_rate;
+        offset += header.frame_size;
+        appended = true;
+    }
+    this->pending.remove(0, offset);
+
+    if (! appended)
+        return;
+    this->Trim();
+    locker.unlock();
+    emit FramesAppended();
+}
+
+void TimeShiftBuffer::Trim()
+{
+    // Only trim once a whole interval is over the limit
+    if (this->frames.isEmpty() || (this->live_time - this->frames[0].time) < (this->max_duration + TIME_SHIFT_TRIM_INTERVAL))
+        return;
+
+    int first_kept = this->FindFrameIndex(this->live_time - this->max_duration);
+    qint64 new_data_offset = this->frames[first_kept].offset;
+    this->data.remove(0, new_data_offset - this->data_offset);
+    this->data_offset = new_data_offset;
+    this->frames.remove(0, first_kept);
+}
+
+void TimeShiftBuffer::Clear()
+{
+    // Offsets continue from the previous data, so that
+    // readers cursors are never re-used for different data.
+    QMutexLocker locker(&this->mutex);
+    this->data_offset += this->data.size();
+    this->data.clear();
+    this->frames.clear();
+    this->pending.clear();
+    this->live_time = 0;
+    locker.unlock();
+    emit Cleared();
+}
+
+int TimeShiftBuffer::FindFrameIndex(qint64 time)
+{
+    // Last frame starting at or before the time
+    QVector<Frame>::const_iterator it = std::upper_bound(
+        this->frames.constBegin(), this->frames.constEnd(), (double)time,
+        [](double value, const Frame& frame) { return value < frame.time; });
+    return std::max(int(it - this->frames.constBegin()) - 1, 0);
+}
+
+qint64 TimeShiftBuffer::FindFrameOffset(qint64 time)
+{
+    QMutexLocker locker(&this->mutex);
+    if (this->frames.isEmpty())
+        return this->GetEndOffset();
+    return this->frames[this->FindFrameIndex(time)].offset;
+}
+
+qint64 TimeShiftBuffer::GetTimeAtOffset(qint64 offset)
+{
+    QMutexLocker locker(&this->mutex);
+    if (this->frames.isEmpty() || offset >= this->GetEndOffset())
+        return this->GetLiveTime();
+
+    QVector<Frame>::const_iterator it = std::upper_bound(
+        this->frames.constBegin(), this->frames.constEnd(), offset,
+        [](qint64 value, const Frame& frame) { return value < frame.offset; });
+    int index = std::max(int(it - this->frames.constBegin()) - 1, 0);
+    return this->frames[index].time;
+}
+
+qint64 TimeShiftBuffer::Read(qint64 offset, char* output, qint64 max_size)
+{
+    QMutexLocker locker(&this->mutex);
+    if (offset < this->data_offset)
+        return 0;
+
+    qint64 read_size = std::max(std::min(max_size, this->GetEndOffset() - offset), (qint64)0);
+    memcpy(output, this->data.constData() + (offset - this->data_offset), read_size);
+    return read_size;
+}
+
+qint64 TimeShiftBuffer::GetStartOffset()
+{
+    QMutexLocker locker(&this->mutex);
+    return this->data_offset;
+}
+
+qint64 TimeShiftBuffer::GetEndOffset()
+{
+    QMutexLocker locker(&this->mutex);
+    return this->data_offset + this->data.size();
+}
+
+qint64 TimeShiftBuffer::GetStartTime()
+{
+    QMutexLocker locker(&this->mutex);
+    return this->frames.isEmpty() ? this->GetLiveTime() : this->frames[0].time;
+}
+
+qint64 TimeShiftBuffer::GetLiveTime()
+{
+    QMutexLocker locker(&this->mutex);
+    return this->live_time;
+}
+
+qint64 TimeShiftBuffer::GetSize()
+{
+    QMutexLocker locker(&this->mutex);
+    return this->data.size();
+}
+
+TimeShiftReader::TimeShiftReader(TimeShiftBuffer* buffer, qint64 delay)
+{
+    this->buffer = buffer;
+    this->read_time = 0;
+    this->StartSegment(buffer->GetLiveTime() - delay);
+    QObject::connect(buffer, SIGNAL(FramesAppended()), this, SLOT(OnFramesAppended()));
+    QObject::connect(buffer, SIGNAL(Cleared()), this, SLOT(OnCleared()));
+    this->open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+qint64 TimeShiftReader::GetStreamTime()
+{
+    // Amount of audio passed to the backend so far
+    if (this->segments.isEmpty())
+        return 0;
+    return this->segments.last().stream_time + this->read_time - this->segments.last().buffer_time;
+}
+
+void TimeShiftReader::StartSegment(qint64 time)
+{
+    // Limited to the oldest frame held
+    time = std::max(time, this->buffer->GetStartTime());
+    Segment segment;
+    segment.stream_time = this->GetStreamTime();
+    this->cursor = this->buffer->FindFrameOffset(time);
+    this->read_time = this->buffer->GetTimeAtOffset(this->cursor);
+    segment.buffer_time = this->read_time;
+    this->segments.append(segment);
+}
+
+void TimeShiftReader::Rewind(qint64 step)
+{
+    // Backend has already buffered audio up to the read time, which it
+    // will play before the audio read from the new position.
+    this->StartSegment(this->read_time - step);
+    emit readyRead();
+}
+
+qint64 TimeShiftReader::GetDelay(qint64 played_position)
+{
+    // Played position falls in the last segment started before it
+    int segment_index = this->segments.count() - 1;
+    while (segment_index > 0 && this->segments[segment_index].stream_time > played_position)
+        segment_index --;
+    const Segment& segment = this->segments[segment_index];
+    qint64 played_time = segment.buffer_time + played_position - segment.stream_time;
+    return std::max(this->buffer->GetLiveTime() - played_time, (qint64)0);
+}
+
+bool TimeShiftReader::isSequential() const
+{
+    return true;
+}
+
+qint64 TimeShiftReader::bytesAvailable() const
+{
+    return std::max(this->buffer->GetEndOffset() - this->cursor, (qint64)0) + QIODevice::bytesAvailable();
+}
+
+qint64 TimeShiftReader::readData(char* data, qint64 max_size)
+{
+    // Oldest frames may have been dropped since the last read
+    this->cursor = std::max(this->cursor, this->buffer->GetStartOffset());
+
+    qint64 read_size = this->buffer->Read(this->cursor, data, max_size);
+    this->cursor += read_size;
+    this->read_time = this->buffer->GetTimeAtOffset(this->cursor);
+    return read_size;
+}
+
+qint64 TimeShiftReader::writeData(const char* data, qint64 max_size)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(max_size);
+    return -1;
+}
+
+void TimeShiftReader::OnFramesAppended()
+{
+    emit readyRead();
+}
+
+void TimeShiftReader::OnCleared()
+{
+    // Buffer time restarts from zero, which is where the data
+    // read so far ends, as far as the backend is concerned.
+    for (int itx = 0; itx < this->segments.count(); itx ++)
+        this->segments[itx].buffer_time -= this->read_time;
+    this->read_time = 0;
+    this->cursor = this->buffer->GetEndOffset();
+}
+
+TimeShiftRecorder::TimeShiftRecorder(QString file_path, Schedule* schedule, TimeShiftBuffer* buffer)
+{
+    this->station_file_path = file_path;
+    this->schedule = schedule;
+    this->buffer = buffer;
+    this->started = false;
+    this->recorded_time = 0;
+    this->item.type = SCHEDULE_ITEM_MUSIC;
+    this->item.start = 0;
+    this->item.end = -1;
+    this->duration = 0;
+    this->audio_start = 0;
+    this->audio_end = 0;
+}
+
+void TimeShiftRecorder::StartItem(qint64 timeline_position)
+{
+    this->item = this->schedule->GetItemAt(timeline_position);
+    QString file_path = this->item.type == SCHEDULE_ITEM_MUSIC ? this->station_file_path : this->item.file_path;
+    if (this->file.fileName() != file_path || ! this->file.isOpen())
+    {
+        this->file.close();
+        this->file.setFileName(file_path);
+        this->file.open(QIODevice::ReadOnly);
+        Mp3Info info(file_path);
+        this->duration = info.GetDuration();
+        this->audio_start = info.GetAudioStart();
+        this->audio_end = info.GetAudioEnd();
+    }
+    if (this->duration <= 0)
+        return;
+
+    qint64 file_position = this->item.type == SCHEDULE_ITEM_MUSIC ? timeline_position % this->duration : timeline_position - this->item.start;
+    this->Seek(std::min(std::max(file_position, (qint64)0), this->duration));
+}
+
+void TimeShiftRecorder::Seek(qint64 file_position)
+{
+    // Seek to the approximate byte offset of the position, then find the next frame
+    qint64 offset = this->audio_start + (this->audio_end - this->audio_start) * file_position / this->duration;
+    this->file.seek(offset);
+    QByteArray head = this->file.peek(MP3_MAX_SYNC_SEARCH);
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(head.constData());
+    Mp3FrameHeader header;
+    Mp3FrameHeader next_header;
+    for (int sync = 0; sync + MP3_FRAME_HEADER_SIZE <= head.size(); sync ++)
+    {
+        if (! Mp3Info::ParseFrameHeader(data + sync, header))
+            continue;
+        if (sync + header.frame_size + MP3_FRAME_HEADER_SIZE <= head.size() &&
+            ! Mp3Info::ParseFrameHeader(data + sync + header.frame_size, next_header))
+            continue;
+        this->file.seek(offset + sync);
+        return;
+    }
+}
+
+double TimeShiftRecorder::RecordFrame()
+{
+    // Music loops at the end of the file, as the station does,
+    // whereas interstitials are over once their file ends.
+    if (this->file.pos() + MP3_FRAME_HEADER_SIZE > this->audio_end)
+    {
+        if (this->item.type != SCHEDULE_ITEM_MUSIC)
+            return 0;
+        this->file.seek(this->audio_start);
+    }
+
+    QByteArray header_data = this->file.peek(MP3_FRAME_HEADER_SIZE);
+    Mp3FrameHeader header;
+    if (header_data.size() < MP3_FRAME_HEADER_SIZE ||
+        ! Mp3Info::ParseFrameHeader(reinterpret_cast<const unsigned char*>(header_data.constData()), header))
+        return 0;
+
+    this->buffer->Append(this->file.read(header.frame_size));
+    return header.samples_per_frame * 1000.0 / header.sample_rate;
+}
+
+void TimeShiftRecorder::Update(qint64 timeline_position)
+{
+    if (timeline_position < 0)
+        return;
+
+    // Global timer may have been reset, or the recorder not updated for
+    // so long that catching up is not worthwhile. Recording carries on
+    // from the timeline, leaving a jump, rather than losing what is held.
+    double behind = timeline_position - this->recorded_time;
+    if (! this->started || behind > TIME_SHIFT_RECORD_MAX_GAP || behind < -TIME_SHIFT_RECORD_MAX_GAP)
+    {
+        this->started = true;
+        this->recorded_time = timeline_position;
+        this->StartItem(timeline_position);
+    }
+
+    while (this->recorded_time < timeline_position)
+    {
+        // Move on to the next item of the schedule once the current one ends
+        if (this->item.end >= 0 && this->recorded_time >= this->item.end)
+            this->StartItem(this->recorded_time);
+
+        double recorded = this->duration > 0 && this->file.isOpen() ? this->RecordFrame() : 0;
+        if (recorded > 0)
+        {
+            this->recorded_time += recorded;
+        }
+        else if (this->item.end >= 0)
+        {
+            // Interstitial ended early, or its file is unreadable
+            this->recorded_time = this->item.end;
+        }
+        else
+        {
+            // Lost sync with the frames of the station file, so carry on from the timeline
+            this->recorded_time = timeline_position;
+            this->StartItem(timeline_position);
+            return;
+        }
+    }
+}
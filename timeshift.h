@@ -0,0 +1,155 @@
+#ifndef TIMESHIFT_H
+#define TIMESHIFT_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QByteArray>
+#include <QVector>
+#include <QFile>
+#include <QMutex>
+
+#include "schedule.h"
+
+// Default amount of audio (ms) kept for rewinding
+#define TIME_SHIFT_DEFAULT_DURATION 600000
+// Frames are dropped in batches of this length (ms), to avoid
+// moving the buffer for every frame.
+#define TIME_SHIFT_TRIM_INTERVAL 10000
+// If the recorder falls further behind than this (ms), the missed audio
+// is skipped rather than caught up on, leaving a jump in the recording.
+#define TIME_SHIFT_RECORD_MAX_GAP 60000
+
+// Ring of compressed MP3 frames for a station, indexed by time.
+// Time is the amount of audio (ms) appended since the buffer was
+// (re)started, so the newest frame is the live position.
+// Frames are appended in the GUI thread and read by players in
+// their own threads, so all access is locked.
+class TimeShiftBuffer : public QObject
+{
+    Q_OBJECT
+
+public:
+    TimeShiftBuffer(qint64 max_duration, QObject* parent = nullptr);
+
+    void Append(const QByteArray& data);
+    void Clear();
+    qint64 GetStartTime();
+    qint64 GetLiveTime();
+    qint64 GetSize();
+
+    // Used by readers
+    qint64 FindFrameOffset(qint64 time);
+    qint64 GetTimeAtOffset(qint64 offset);
+    qint64 Read(qint64 offset, char* data, qint64 max_size);
+    qint64 GetStartOffset();
+    qint64 GetEndOffset();
+
+signals:
+    void FramesAppended();
+    void Cleared();
+
+private:
+    struct Frame
+    {
+        // Absolute byte offset of the frame and time at its start
+        qint64 offset;
+        double time;
+    };
+
+    QMutex mutex;
+    qint64 max_duration;
+    QByteArray data;
+    // Absolute offset of first byte held in data
+    qint64 data_offset;
+    QVector<Frame> frames;
+    double live_time;
+    // Partial frame, waiting for the rest of its data
+    QByteArray pending;
+
+    int FindFrameIndex(qint64 time);
+    void Trim();
+};
+
+// Sequential device, playing from a point in a time shift buffer.
+// The backend reads ahead of what is being heard, so the delay is
+// measured from the position the backend has played to. Rewinding
+// only moves where the next read comes from, so the backend is not
+// touched: audio it has already buffered plays out, then the earlier
+// audio follows on seamlessly.
+class TimeShiftReader : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    TimeShiftReader(TimeShiftBuffer* buffer, qint64 delay);
+
+    // Moves back (ms) from the audio the backend has read up to
+    void Rewind(qint64 step);
+    // Delay of the audio at the played position (ms) since the reader was started
+    qint64 GetDelay(qint64 played_position);
+
+    bool isSequential() const override;
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char* data, qint64 max_size) override;
+    qint64 writeData(const char* data, qint64 max_size) override;
+
+private slots:
+    void OnFramesAppended();
+    void OnCleared();
+
+private:
+    // Audio read from one point in the buffer, starting at a time in
+    // the audio passed to the backend, which is continuous.
+    struct Segment
+    {
+        qint64 stream_time;
+        qint64 buffer_time;
+    };
+
+    TimeShiftBuffer* buffer;
+    qint64 cursor;
+    // Buffer time of the data read
+    qint64 read_time;
+    QVector<Segment> segments;
+
+    void StartSegment(qint64 time);
+    qint64 GetStreamTime();
+};
+
+// Records a station into a time shift buffer, following the position
+// of the global timeline. The station's schedule is followed, recording
+// each item from its own file, as the player would play it: music loops
+// on the global timeline, whereas interstitials play once from the start
+// of the item.
+// Late updates are caught up on, so the recording is continuous.
+class TimeShiftRecorder
+{
+
+public:
+    TimeShiftRecorder(QString file_path, Schedule* schedule, TimeShiftBuffer* buffer);
+
+    void Update(qint64 timeline_position);
+
+private:
+    QString station_file_path;
+    Schedule* schedule;
+    TimeShiftBuffer* buffer;
+    bool started;
+    // Timeline position (ms) of the next frame to be recorded
+    double recorded_time;
+
+    // Item being recorded, and its file
+    ScheduleItem item;
+    QFile file;
+    qint64 duration;
+    qint64 audio_start;
+    qint64 audio_end;
+
+    void StartItem(qint64 timeline_position);
+    void Seek(qint64 file_position);
+    double RecordFrame();
+};
+
+#endif // TIMESHIFT_H
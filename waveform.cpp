@@ -0,0 +1,350 @@
+#include "waveform.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QAudioBuffer>
+#include <QtConcurrent>
+
+#include "stationdecoder.h"
+
+Waveform::Waveform(QString cache_path) : file(cache_path)
+{
+    this->data = nullptr;
+    this->header = nullptr;
+    if (! this->file.open(QIODevice::ReadOnly) || this->file.size() < (qint64)sizeof(WaveformHeader))
+        return;
+
+    // Levels are read straight from the mapped file, when drawn
+    this->data = this->file.map(0, this->file.size());
+    if (this->data == nullptr)
+        return;
+
+    const WaveformHeader* header = reinterpret_cast<const WaveformHeader*>(this->data);
+    if (header->magic != WAVEFORM_MAGIC || header->version != WAVEFORM_VERSION ||
+        header->level_count < 1 || header->level_count > WAVEFORM_MAX_LEVELS || header->bucket_duration == 0)
+        return;
+    // Levels must lie after the header and within the file. Counts are
+    // compared with the space left, so that a corrupt cache cannot overflow.
+    for (quint32 level = 0; level < header->level_count; level ++)
+        if (header->level_offsets[level] < (qint64)sizeof(WaveformHeader) || header->level_offsets[level] > this->file.size() ||
+            header->level_counts[level] < 0 ||
+            header->level_counts[level] > (this->file.size() - header->level_offsets[level]) / (qint64)sizeof(WaveformBucket))
+            return;
+    this->header = header;
+}
+
+bool Waveform::IsValid()
+{
+    return this->header != nullptr;
+}
+
+qint64 Waveform::GetDuration()
+{
+    return this->header->duration;
+}
+
+int Waveform::GetLevelCount()
+{
+    return this->header->level_count;
+}
+
+qint64 Waveform::GetBucketDuration(int level)
+{
+    return (qint64)this->header->bucket_duration << level;
+}
+
+qint64 Waveform::GetBucketCount(int level)
+{
+    return this->header->level_counts[level];
+}
+
+const WaveformBucket* Waveform::GetBuckets(int level)
+{
+    return reinterpret_cast<const WaveformBucket*>(this->data + this->header->level_offsets[level]);
+}
+
+int Waveform::FindLevel(double duration)
+{
+    int level = 0;
+    while (level + 1 < this->GetLevelCount() && this->GetBucketDuration(level + 1) <= duration)
+        level ++;
+    return level;
+}
+
+QString Waveform::GetCachePath(QString file_path)
+{
+    QByteArray hash = QCryptographicHash::hash(QFileInfo(file_path).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/" + WAVEFORM_CACHE_DIRECTORY + "/" +
+           QString::fromLatin1(hash.toHex()) + WAVEFORM_CACHE_SUFFIX;
+}
+
+bool Waveform::IsCached(QString file_path)
+{
+    QFile cache(Waveform::GetCachePath(file_path));
+    if (! cache.open(QIODevice::ReadOnly))
+        return false;
+
+    WaveformHeader header;
+    if (cache.read(reinterpret_cast<char*>(&header), sizeof(header)) != sizeof(header))
+        return false;
+
+    // Rebuilt if the station file has been replaced
+    QFileInfo source(file_path);
+    return header.magic == WAVEFORM_MAGIC && header.version == WAVEFORM_VERSION &&
+           header.source_size == source.size() &&
+           header.source_modified == source.lastModified().toMSecsSinceEpoch();
+}
+
+bool Waveform::Build(QString file_path, QAtomicInt* cancelled)
+{
+    QFileInfo source(file_path);
+    WaveformBuilder builder(file_path, cancelled);
+    if (! builder.Run())
+        return false;
+
+    // Each level summarises pairs of buckets of the level below,
+    // until the whole file is a single bucket.
+    QList<QVector<WaveformBucket>> levels;
+    levels.append(builder.GetBuckets());
+    while (levels.last().count() > 1 && levels.count() < WAVEFORM_MAX_LEVELS)
+    {
+        const QVector<WaveformBucket>& below = levels.last();
+        QVector<WaveformBucket> level((below.count() + 1) / 2);
+        for (int itx = 0; itx < level.count(); itx ++)
+        {
+            const WaveformBucket& first = below[itx * 2];
+            const WaveformBucket& second = itx * 2 + 1 < below.count() ? below[itx * 2 + 1] : first;
+            level[itx].min = std::min(first.min, second.min);
+            level[itx].max = std::max(first.max, second.max);
+            level[itx].rms = std::sqrt((first.rms * first.rms + second.rms * second.rms) / 2.0);
+        }
+        levels.append(level);
+    }
+
+    WaveformHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = WAVEFORM_MAGIC;
+    header.version = WAVEFORM_VERSION;
+    header.source_size = source.size();
+    header.source_modified = source.lastModified().toMSecsSinceEpoch();
+    header.duration = builder.GetDuration();
+    header.bucket_duration = WAVEFORM_BUCKET_DURATION;
+    header.level_count = levels.count();
+    qint64 offset = sizeof(header);
+    for (int level = 0; level < levels.count(); level ++)
+    {
+        header.level_offsets[level] = offset;
+        header.level_counts[level] = levels[level].count();
+        offset += levels[level].count() * sizeof(WaveformBucket);
+    }
+
+    // Write to temporary file and rename, so readers never see a partial file
+    QString cache_path = Waveform::GetCachePath(file_path);
+    QDir().mkpath(QFileInfo(cache_path).absolutePath());
+    QSaveFile file(cache_path);
+    if (! file.open(QIODevice::WriteOnly))
+        return false;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (int level = 0; level < levels.count(); level ++)
+        file.write(reinterpret_cast<const char*>(levels[level].constData()), levels[level].count() * sizeof(WaveformBucket));
+    return file.commit();
+}
+
+Waveform::~Waveform()
+{
+    if (this->data != nullptr)
+        this->file.unmap(this->data);
+}
+
+WaveformBuilder::WaveformBuilder(QString file_path, QAtomicInt* cancelled)
+{
+    this->file_path = file_path;
+    this->cancelled = cancelled;
+    this->decoder = nullptr;
+    this->failed = false;
+    this->frame_count = 0;
+    this->bucket_frames = 0;
+    this->bucket_min = 0;
+    this->bucket_max = 0;
+    this->bucket_sum_squares = 0;
+}
+
+bool WaveformBuilder::Run()
+{
+    this->decoder = new QAudioDecoder(this);
+    this->decoder->setAudioFormat(StationDecoder::GetFormat());
+    QObject::connect(this->decoder, SIGNAL(bufferReady()), this, SLOT(OnBufferReady()));
+    QObject::connect(this->decoder, SIGNAL(finished()), this, SLOT(OnFinished()));
+    QObject::connect(this->decoder, SIGNAL(error(QAudioDecoder::Error)), this, SLOT(OnError(QAudioDecoder::Error)));
+    this->decoder->setSourceFilename(this->file_path);
+    this->decoder->start();
+
+    // Decoder reports through signals, so run an event loop in this thread
+    this->loop.exec();
+
+    if (this->bucket_frames > 0)
+        this->AddBucket();
+    return ! this->failed && ! this->buckets.isEmpty();
+}
+
+void WaveformBuilder::OnBufferReady()
+{
+    QAudioBuffer buffer = this->decoder->read();
+    if (this->cancelled->loadAcquire())
+    {
+        this->failed = true;
+        this->decoder->stop();
+        this->loop.quit();
+        return;
+    }
+
+    // Samples are read as interleaved 16 bit stereo, so any other format is unusable
+    if (buffer.format() != StationDecoder::GetFormat())
+    {
+        std::cout << "Waveform: unexpected audio format decoding " << this->file_path.toStdString() << std::endl;
+        this->failed = true;
+        this->decoder->stop();
+        this->loop.quit();
+        return;
+    }
+
+    // Channels are mixed, as only the overall level is drawn
+    const qint16* samples = buffer.constData<qint16>();
+    int frames_per_bucket = DECODER_SAMPLE_RATE * WAVEFORM_BUCKET_DURATION / 1000;
+    for (int frame = 0; frame < buffer.frameCount(); frame ++)
+    {
+        int value = (samples[frame * DECODER_CHANNELS] + samples[frame * DECODER_CHANNELS + 1]) / 2;
+        if (this->bucket_frames == 0)
+        {
+            this->bucket_min = value;
+            this->bucket_max = value;
+        }
+        this->bucket_min = std::min(this->bucket_min, value);
+        this->bucket_max = std::max(this->bucket_max, value);
+        this->bucket_sum_squares += (double)value * value;
+        this->bucket_frames ++;
+        if (this->bucket_frames == frames_per_bucket)
+            this->AddBucket();
+    }
+    this->frame_count += buffer.frameCount();
+}
+
+void WaveformBuilder::AddBucket()
+{
+    WaveformBucket bucket;
+    bucket.min = this->bucket_min >> 8;
+    bucket.max = this->bucket_max >> 8;
+    bucket.rms = std::min(std::sqrt(this->bucket_sum_squares / this->bucket_frames) / 128.0, 255.0);
+    this->buckets.append(bucket);
+
+    this->bucket_frames = 0;
+    this->bucket_sum_squares = 0;
+}
+
+void WaveformBuilder::OnFinished()
+{
+    this->loop.quit();
+}
+
+void WaveformBuilder::OnError(QAudioDecoder::Error error)
+{
+    Q_UNUSED(error);
+    std::cout << "Waveform: unable to decode " << this->file_path.toStdString() << ": " << this->decoder->errorString().toStdString() << std::endl;
+    this->failed = true;
+    this->loop.quit();
+}
+
+QVector<WaveformBucket> WaveformBuilder::GetBuckets()
+{
+    return this->buckets;
+}
+
+qint64 WaveformBuilder::GetDuration()
+{
+    return this->frame_count * 1000 / DECODER_SAMPLE_RATE;
+}
+
+WaveformLibrary::WaveformLibrary(QObject* parent) : QObject(parent)
+{
+    // Pool is sized to the number of cores
+    this->cancelled.storeRelease(0);
+}
+
+void WaveformLibrary::SetStations(QList<Station*> stations)
+{
+    // Streams are live, so have no waveform, and packed stations
+    // share the file of the pack.
+    QSet<QString> file_paths;
+    for (int itx = 0; itx < stations.count(); itx ++)
+        if (! stations[itx]->IsStream() && ! stations[itx]->IsPacked())
+            file_paths.insert(stations[itx]->GetFilePath());
+
+    // Unmap waveforms of stations that have been removed, or whose
+    // station file has changed since they were built. The stale one
+    // must be unmapped before the cache file is replaced.
+    QList<QString> mapped = this->waveforms.keys();
+    for (int itx = 0; itx < mapped.count(); itx ++)
+        if (! file_paths.contains(mapped[itx]) || ! Waveform::IsCached(mapped[itx]))
+            delete this->waveforms.take(mapped[itx]);
+
+    QList<QString> new_paths = file_paths.values();
+    for (int itx = 0; itx < new_paths.count(); itx ++)
+    {
+        QString file_path = new_paths[itx];
+        if (this->waveforms.contains(file_path) || this->building.contains(file_path) || Waveform::IsCached(file_path))
+            continue;
+
+        QFutureWatcher<bool>* watcher = new QFutureWatcher<bool>(this);
+        QObject::connect(watcher, SIGNAL(finished()), this, SLOT(OnBuildFinished()));
+        this->builds.insert(watcher, file_path);
+        this->building.insert(file_path);
+        watcher->setFuture(QtConcurrent::run(&this->pool, Waveform::Build, file_path, &this->cancelled));
+    }
+}
+
+Waveform* WaveformLibrary::GetWaveform(QString file_path)
+{
+    if (this->waveforms.contains(file_path))
+        return this->waveforms[file_path];
+    if (this->building.contains(file_path) || ! Waveform::IsCached(file_path))
+        return nullptr;
+
+    Waveform* waveform = new Waveform(Waveform::GetCachePath(file_path));
+    if (! waveform->IsValid())
+    {
+        delete waveform;
+        return nullptr;
+    }
+    this->waveforms.insert(file_path, waveform);
+    return waveform;
+}
+
+void WaveformLibrary::OnBuildFinished()
+{
+    QFutureWatcher<bool>* watcher = static_cast<QFutureWatcher<bool>*>(this->sender());
+    QString file_path = this->builds.take(watcher);
+    this->building.remove(file_path);
+    if (watcher->result())
+    {
+        std::cout << "Waveform built for " << file_path.toStdString() << std::endl;
+        emit WaveformReady(file_path);
+    }
+    watcher->deleteLater();
+}
+
+WaveformLibrary::~WaveformLibrary()
+{
+    // Stop builds that are running, rather than waiting for them to decode
+    this->cancelled.storeRelease(1);
+    this->pool.waitForDone();
+    qDeleteAll(this->waveforms);
+}
@@ -0,0 +1,147 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QSet>
+#include <QFile>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QEventLoop>
+#include <QAudioDecoder>
+#include <QVector>
+
+#include "station.h"
+
+// Waveforms are cached in this sub-directory of the cache location,
+// named after a hash of the station file path.
+#define WAVEFORM_CACHE_DIRECTORY "waveforms"
+#define WAVEFORM_CACHE_SUFFIX ".waveform"
+#define WAVEFORM_MAGIC 0x57415447
+#define WAVEFORM_VERSION 1
+// Duration (ms) of each bucket of the most detailed level.
+// Each level above summarises two buckets of the level below.
+#define WAVEFORM_BUCKET_DURATION 100
+#define WAVEFORM_MAX_LEVELS 32
+
+// Summary of the audio in a bucket, scaled to 8 bits
+struct WaveformBucket
+{
+    qint8 min;
+    qint8 max;
+    quint8 rms;
+};
+
+// Start of a waveform file, followed by the buckets of each level
+struct WaveformHeader
+{
+    quint32 magic;
+    quint32 version;
+    // Station file the waveform was built from, to detect changes
+    qint64 source_size;
+    qint64 source_modified;
+    qint64 duration;
+    quint32 bucket_duration;
+    quint32 level_count;
+    qint64 level_offsets[WAVEFORM_MAX_LEVELS];
+    qint64 level_counts[WAVEFORM_MAX_LEVELS];
+};
+
+// Min/max/RMS pyramid of a station file, memory mapped from the cache.
+// Drawing at any zoom only reads the level with the nearest bucket
+// duration, never the audio.
+class Waveform
+{
+
+public:
+    Waveform(QString cache_path);
+    ~Waveform();
+
+    bool IsValid();
+    qint64 GetDuration();
+    int GetLevelCount();
+    qint64 GetBucketDuration(int level);
+    qint64 GetBucketCount(int level);
+    const WaveformBucket* GetBuckets(int level);
+    // Most detailed level with buckets at least this long
+    int FindLevel(double duration);
+
+    static QString GetCachePath(QString file_path);
+    static bool IsCached(QString file_path);
+    // Decodes the file and writes its waveform to the cache
+    static bool Build(QString file_path, QAtomicInt* cancelled);
+
+private:
+    QFile file;
+    uchar* data;
+    const WaveformHeader* header;
+};
+
+// Decodes a station file, summarising it into the buckets of the
+// most detailed level. Runs in a thread of the waveform library.
+class WaveformBuilder : public QObject
+{
+    Q_OBJECT
+
+public:
+    WaveformBuilder(QString file_path, QAtomicInt* cancelled);
+
+    bool Run();
+    QVector<WaveformBucket> GetBuckets();
+    qint64 GetDuration();
+
+private slots:
+    void OnBufferReady();
+    void OnFinished();
+    void OnError(QAudioDecoder::Error error);
+
+private:
+    QString file_path;
+    QAtomicInt* cancelled;
+    QAudioDecoder* decoder;
+    QEventLoop loop;
+    bool failed;
+    QVector<WaveformBucket> buckets;
+    qint64 frame_count;
+
+    // Bucket being summarised
+    int bucket_frames;
+    int bucket_min;
+    int bucket_max;
+    double bucket_sum_squares;
+
+    void AddBucket();
+};
+
+// Waveforms of the stations, which are built in parallel when the
+// stations are scanned, if they are not already cached.
+class WaveformLibrary : public QObject
+{
+    Q_OBJECT
+
+public:
+    WaveformLibrary(QObject* parent = nullptr);
+    ~WaveformLibrary();
+
+    void SetStations(QList<Station*> stations);
+    // Returns nullptr if the waveform has not (yet) been built
+    Waveform* GetWaveform(QString file_path);
+
+signals:
+    void WaveformReady(QString file_path);
+
+private slots:
+    void OnBuildFinished();
+
+private:
+    QThreadPool pool;
+    QAtomicInt cancelled;
+    QHash<QString, Waveform*> waveforms;
+    QHash<QFutureWatcher<bool>*, QString> builds;
+    QSet<QString> building;
+};
+
+#endif // WAVEFORM_H
@@ -0,0 +1,135 @@
+#include "waveformdialog.h"
+#include "mainwindow.h"
+
+#include <cmath>
+#include <algorithm>
+
+#include <QPainter>
+#include <QVBoxLayout>
+#include <QDateTime>
+
+WaveformWidget::WaveformWidget(WaveformLibrary* library, MainWindow* main_window, QWidget* parent) : QWidget(parent)
+{
+    this->library = library;
+    this->main_window = main_window;
+    this->zoom = 0;
+    this->fit_zoom = 0;
+    this->setMinimumSize(200, 80);
+    QObject::connect(library, SIGNAL(WaveformReady(QString)), this, SLOT(update()));
+}
+
+void WaveformWidget::paintEvent(QPaintEvent* event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(this->rect(), this->palette().base());
+
+    Station* station = this->main_window->GetCurrentStation();
+    if (station == nullptr || station->IsStream() || station->IsPacked())
+    {
+        painter.drawText(this->rect(), Qt::AlignCenter, "No waveform for this station");
+        return;
+    }
+    Waveform* waveform = this->library->GetWaveform(station->GetFilePath());
+    if (waveform == nullptr || waveform->GetDuration() <= 0)
+    {
+        painter.drawText(this->rect(), Qt::AlignCenter, "Building waveform...");
+        return;
+    }
+
+    // Station loops on the global timeline with its own duration. The
+    // decoded waveform includes encoder delay and padding, so the
+    // position is scaled into waveform time to stay with the audio.
+    qint64 duration = waveform->GetDuration();
+    qint64 station_duration = station->GetDuration() > 0 ? station->GetDuration() : duration;
+    qint64 timeline_position = QDateTime::currentMSecsSinceEpoch() - this->main_window->GetStartupTime();
+    qint64 station_position = ((timeline_position % station_duration) + station_duration) % station_duration;
+    qint64 position = (double)station_position * duration / station_duration;
+
+    // Zoomed views are centred on the position, where possible
+    int width = this->width();
+    this->fit_zoom = (double)duration / width;
+    double ms_per_pixel = this->zoom > 0 ? std::min(this->zoom, this->fit_zoom) : this->fit_zoom;
+    double view_start = std::max(std::min(position - ms_per_pixel * width / 2, duration - ms_per_pixel * width), 0.0);
+
+    // Only the level matching the zoom is read
+    int level = waveform->FindLevel(ms_per_pixel);
+    const WaveformBucket* buckets = waveform->GetBuckets(level);
+    qint64 bucket_count = waveform->GetBucketCount(level);
+    double bucket_duration = waveform->GetBucketDuration(level);
+
+    int middle = this->height() / 2;
+    double scale = this->height() / 2.0 / 128;
+    QPen peak_pen(this->palette().color(QPalette::Mid));
+    QPen rms_pen(this->palette().color(QPalette::Text));
+    for (int x = 0; x < width; x ++)
+    {
+        double start = view_start + x * ms_per_pixel;
+        qint64 first = start / bucket_duration;
+        qint64 last = std::max(first + 1, (qint64)std::ceil((start + ms_per_pixel) / bucket_duration));
+        if (first >= bucket_count)
+            break;
+        last = std::min(last, bucket_count);
+
+        int min = buckets[first].min;
+        int max = buckets[first].max;
+        int rms = buckets[first].rms;
+        for (qint64 bucket = first + 1; bucket < last; bucket ++)
+        {
+            min = std::min(min, (int)buckets[bucket].min);
+            max = std::max(max, (int)buckets[bucket].max);
+            rms = std::max(rms, (int)buckets[bucket].rms);
+        }
+
+        // RMS is stored with twice the resolution of the peaks
+        painter.setPen(peak_pen);
+        painter.drawLine(x, middle - max * scale, x, middle - min * scale);
+        painter.setPen(rms_pen);
+        painter.drawLine(x, middle - rms * scale / 2, x, middle + rms * scale / 2);
+    }
+
+    int marker = (position - view_start) / ms_per_pixel;
+    painter.setPen(QPen(Qt::red));
+    painter.drawLine(marker, 0, marker, this->height());
+}
+
+void WaveformWidget::wheelEvent(QWheelEvent* event)
+{
+    if (this->fit_zoom <= 0)
+        return;
+
+    // Each step doubles or halves the span shown
+    double current = this->zoom > 0 ? this->zoom : this->fit_zoom;
+    if (event->angleDelta().y() > 0)
+        this->zoom = std::max(current / 2, (double)WAVEFORM_MIN_ZOOM);
+    else if (event->angleDelta().y() < 0)
+        this->zoom = current * 2 >= this->fit_zoom ? 0 : current * 2;
+    this->update();
+}
+
+WaveformDialog::WaveformDialog(WaveformLibrary* library, MainWindow* main_window, QWidget* parent) : QDialog(parent)
+{
+    this->setWindowTitle("Waveform");
+    this->resize(600, 150);
+
+    this->waveform_widget = new WaveformWidget(library, main_window, this);
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(this->waveform_widget);
+
+    this->update_timer = new QTimer(this);
+    QObject::connect(this->update_timer, SIGNAL(timeout()), this->waveform_widget, SLOT(update()));
+}
+
+void WaveformDialog::showEvent(QShowEvent* event)
+{
+    QDialog::showEvent(event);
+
+    // Marker only needs to move whilst visible
+    this->update_timer->start(WAVEFORM_DIALOG_UPDATE_INTERVAL);
+}
+
+void WaveformDialog::hideEvent(QHideEvent* event)
+{
+    QDialog::hideEvent(event);
+    this->update_timer->stop();
+}
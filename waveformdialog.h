@@ -0,0 +1,60 @@
+#ifndef WAVEFORMDIALOG_H
+#define WAVEFORMDIALOG_H
+
+#include <QDialog>
+#include <QWidget>
+#include <QTimer>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QShowEvent>
+#include <QHideEvent>
+
+#include "waveform.h"
+
+class MainWindow;
+
+// Interval (ms) at which the position marker is moved whilst shown
+#define WAVEFORM_DIALOG_UPDATE_INTERVAL 200
+// Narrowest span of audio (ms per pixel) that can be zoomed in to
+#define WAVEFORM_MIN_ZOOM WAVEFORM_BUCKET_DURATION
+
+// Waveform of the current station, with a marker at the live position.
+// Scrolling zooms in around the marker.
+class WaveformWidget : public QWidget
+{
+    Q_OBJECT
+
+public:
+    WaveformWidget(WaveformLibrary* library, MainWindow* main_window, QWidget* parent = nullptr);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void wheelEvent(QWheelEvent* event) override;
+
+private:
+    WaveformLibrary* library;
+    MainWindow* main_window;
+    // Audio (ms) drawn in each pixel, or 0 to fit the whole station
+    double zoom;
+    // Zoom that fits the whole station, as last drawn
+    double fit_zoom;
+};
+
+// Panel showing the waveform of the current station
+class WaveformDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    WaveformDialog(WaveformLibrary* library, MainWindow* main_window, QWidget* parent = nullptr);
+
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private:
+    WaveformWidget* waveform_widget;
+    QTimer* update_timer;
+};
+
+#endif // WAVEFORMDIALOG_H
@@ -0,0 +1,198 @@
+#include "zone.h"
+
+#include <iostream>
+#include <cstring>
+
+Zone::Zone(QAudioDeviceInfo device, DecoderPool* decoder_pool)
+{
+    this->device = device;
+    this->decoder_pool = decoder_pool;
+    this->decoder = nullptr;
+    this->listener_id = -1;
+    this->volume = 0;
+    this->output = new QAudioOutput(device, StationDecoder::GetFormat(), this);
+    this->open(QIODevice::ReadOnly);
+}
+
+void Zone::Play(QString station_file, qint64 timeline_position)
+{
+    this->Stop();
+
+    if (! this->device.isFormatSupported(StationDecoder::GetFormat()))
+    {
+        std::cout << "Zone " << this->GetDeviceName().toStdString() << ": Output format not supported by device" << std::endl;
+        return;
+    }
+
+    this->station_file = station_file;
+    this->decoder = this->decoder_pool->Acquire(station_file, timeline_position);
+    this->listener_id = this->decoder->AddListener();
+
+    // Output pulls audio from the zone as it requires it
+    this->output->start(this);
+}
+
+void Zone::Stop()
+{
+    this->output->stop();
+
+    if (this->decoder == nullptr)
+        return;
+
+    this->decoder->RemoveListener(this->listener_id);
+    this->decoder_pool->Release(this->decoder);
+    this->decoder = nullptr;
+    this->listener_id = -1;
+}
+
+qint64 Zone::readData(char* data, qint64 max_size)
+{
+    // Decoder fills with silence if it has not caught up, rather than
+    // letting the output stall, and keeps the zone on the timeline.
+    if (this->decoder != nullptr)
+        return this->decoder->Read(this->listener_id, data, max_size);
+
+    memset(data, 0, max_size);
+    return max_size;
+}
+
+qint64 Zone::writeData(const char* data, qint64 max_size)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(max_size);
+    return -1;
+}
+
+void Zone::SetVolume(int volume)
+{
+    this->volume = volume;
+    this->output->setVolume(volume / 100.0);
+}
+
+int Zone::GetVolume()
+{
+    return this->volume;
+}
+
+QString Zone::GetDeviceName()
+{
+    return this->device.deviceName();
+}
+
+void Zone::SetStationFile(QString station_file)
+{
+    this->Stop();
+    this->station_file = station_file;
+}
+
+QString Zone::GetStationFile()
+{
+    return this->station_file;
+}
+
+Zone::~Zone()
+{
+    this->Stop();
+}
+
+ZoneManager::ZoneManager(QSettings* settings, QObject* parent) : QObject(parent)
+{
+    this->settings = settings;
+    this->playing = true;
+}
+
+QStringList ZoneManager::GetDeviceNames()
+{
+    QStringList device_names;
+    QList<QAudioDeviceInfo> devices = QAudioDeviceInfo::availableDevices(QAudio::AudioOutput);
+    for (int itx = 0; itx < devices.count(); itx ++)
+        device_names << devices[itx].deviceName();
+    return device_names;
+}
+
+Zone* ZoneManager::AddZone(QString device_name, QString station_file, int volume, qint64 timeline_position)
+{
+    QList<QAudioDeviceInfo> devices = QAudioDeviceInfo::availableDevices(QAudio::AudioOutput);
+    for (int itx = 0; itx < devices.count(); itx ++)
+    {
+        if (devices[itx].deviceName() != device_name)
+            continue;
+
+        Zone* zone = new Zone(devices[itx], &this->decoder_pool);
+        zone->SetVolume(volume);
+        if (this->playing)
+            zone->Play(station_file, timeline_position);
+        else
+            zone->SetStationFile(station_file);
+        this->zones.append(zone);
+        std::cout << "Added zone on " << device_name.toStdString() << ", decoders running: " << this->decoder_pool.GetDecoderCount() << std::endl;
+        return zone;
+    }
+
+    std::cout << "Zone output device not found: " << device_name.toStdString() << std::endl;
+    return nullptr;
+}
+
+void ZoneManager::RemoveZone(int zone_index)
+{
+    if (zone_index < 0 || zone_index >= this->zones.count())
+        return;
+    delete this->zones.takeAt(zone_index);
+}
+
+QList<Zone*> ZoneManager::GetZones()
+{
+    return this->zones;
+}
+
+void ZoneManager::Restore(qint64 timeline_position)
+{
+    int zone_count = this->settings->beginReadArray(SETTINGS_KEY_ZONES);
+    QStringList device_names, station_files;
+    QList<int> volumes;
+    for (int itx = 0; itx < zone_count; itx ++)
+    {
+        this->settings->setArrayIndex(itx);
+        device_names << this->settings->value(SETTINGS_KEY_ZONE_DEVICE).toString();
+        station_files << this->settings->value(SETTINGS_KEY_ZONE_STATION).toString();
+        volumes << this->settings->value(SETTINGS_KEY_ZONE_VOLUME).toInt();
+    }
+    this->settings->endArray();
+
+    for (int itx = 0; itx < zone_count; itx ++)
+        this->AddZone(device_names[itx], station_files[itx], volumes[itx], timeline_position);
+}
+
+void ZoneManager::Save()
+{
+    this->settings->beginWriteArray(SETTINGS_KEY_ZONES, this->zones.count());
+    for (int itx = 0; itx < this->zones.count(); itx ++)
+    {
+        this->settings->setArrayIndex(itx);
+        this->settings->setValue(SETTINGS_KEY_ZONE_DEVICE, this->zones[itx]->GetDeviceName());
+        this->settings->setValue(SETTINGS_KEY_ZONE_STATION, this->zones[itx]->GetStationFile());
+        this->settings->setValue(SETTINGS_KEY_ZONE_VOLUME, this->zones[itx]->GetVolume());
+    }
+    this->settings->endArray();
+}
+
+void ZoneManager::SetTimeline(qint64 timeline_position, bool playing)
+{
+    this->playing = playing;
+
+    // All zones are stopped first, so that decoders shared between
+    // zones are released and restarted at the new position.
+    for (int itx = 0; itx < this->zones.count(); itx ++)
+        this->zones[itx]->Stop();
+    if (! playing)
+        return;
+    for (int itx = 0; itx < this->zones.count(); itx ++)
+        this->zones[itx]->Play(this->zones[itx]->GetStationFile(), timeline_position);
+}
+
+ZoneManager::~ZoneManager()
+{
+    // Zones must be removed before the decoder pool is destroyed
+    qDeleteAll(this->zones);
+    this->zones.clear();
+}
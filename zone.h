@@ -0,0 +1,80 @@
+#ifndef ZONE_H
+#define ZONE_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QString>
+#include <QList>
+#include <QSettings>
+#include <QAudioDeviceInfo>
+#include <QAudioOutput>
+
+#include "stationdecoder.h"
+
+#define SETTINGS_KEY_ZONES "zones"
+#define SETTINGS_KEY_ZONE_DEVICE "device"
+#define SETTINGS_KEY_ZONE_STATION "station"
+#define SETTINGS_KEY_ZONE_VOLUME "volume"
+
+// Additional audio output, playing a station on a chosen output device.
+// Audio is read from a decoder that is shared with any other zone
+// playing the same station, which applies the station's DSP chain.
+class Zone : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    Zone(QAudioDeviceInfo device, DecoderPool* decoder_pool);
+    ~Zone();
+
+    void Play(QString station_file, qint64 timeline_position);
+    void Stop();
+    // Sets the station without playing it, e.g. whilst the timeline is paused
+    void SetStationFile(QString station_file);
+    void SetVolume(int volume);
+    int GetVolume();
+    QString GetDeviceName();
+    QString GetStationFile();
+
+protected:
+    qint64 readData(char* data, qint64 max_size) override;
+    qint64 writeData(const char* data, qint64 max_size) override;
+
+private:
+    QAudioDeviceInfo device;
+    QAudioOutput* output;
+    DecoderPool* decoder_pool;
+    StationDecoder* decoder;
+    int listener_id;
+    int volume;
+    QString station_file;
+};
+
+// Manages the set of zones, which are persisted in the settings.
+// Zones follow the global timeline, so are stopped whilst it is
+// paused and restarted from its position whenever it moves.
+class ZoneManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    ZoneManager(QSettings* settings, QObject* parent = nullptr);
+    ~ZoneManager();
+
+    Zone* AddZone(QString device_name, QString station_file, int volume, qint64 timeline_position);
+    void RemoveZone(int zone_index);
+    QList<Zone*> GetZones();
+    void Restore(qint64 timeline_position);
+    void Save();
+    void SetTimeline(qint64 timeline_position, bool playing);
+
+    static QStringList GetDeviceNames();
+
+private:
+    QSettings* settings;
+    DecoderPool decoder_pool;
+    QList<Zone*> zones;
+    bool playing;
+};
+
+#endif // ZONE_H